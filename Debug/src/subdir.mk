@@ -4,13 +4,79 @@
 
 # Add inputs and outputs from these tool invocations to the build variables 
 CPP_SRCS += \
-../src/Framework.cpp 
+../src/CallContext.cpp \
+../src/CallGenerator.cpp \
+../src/CallRegistry.cpp \
+../src/ConnectionPool.cpp \
+../src/CpsSearch.cpp \
+../src/DirectMedia.cpp \
+../src/DisconnectStats.cpp \
+../src/Framework.cpp \
+../src/Isup.cpp \
+../src/IsupBodyCache.cpp \
+../src/LatencyHistogram.cpp \
+../src/LoopbackBench.cpp \
+../src/MetricsExporter.cpp \
+../src/NullMediaTransport.cpp \
+../src/PacketCapture.cpp \
+../src/PayloadCache.cpp \
+../src/RtpPacer.cpp \
+../src/RtpShards.cpp \
+../src/RtpStats.cpp \
+../src/SdpTemplates.cpp \
+../src/ShardSupervisor.cpp \
+../src/SipTransports.cpp \
+../src/TimerWheel.cpp 
 
 OBJS += \
-./src/Framework.o 
+./src/CallContext.o \
+./src/CallGenerator.o \
+./src/CallRegistry.o \
+./src/ConnectionPool.o \
+./src/CpsSearch.o \
+./src/DirectMedia.o \
+./src/DisconnectStats.o \
+./src/Framework.o \
+./src/Isup.o \
+./src/IsupBodyCache.o \
+./src/LatencyHistogram.o \
+./src/LoopbackBench.o \
+./src/MetricsExporter.o \
+./src/NullMediaTransport.o \
+./src/PacketCapture.o \
+./src/PayloadCache.o \
+./src/RtpPacer.o \
+./src/RtpShards.o \
+./src/RtpStats.o \
+./src/SdpTemplates.o \
+./src/ShardSupervisor.o \
+./src/SipTransports.o \
+./src/TimerWheel.o 
 
 CPP_DEPS += \
-./src/Framework.d 
+./src/CallContext.d \
+./src/CallGenerator.d \
+./src/CallRegistry.d \
+./src/ConnectionPool.d \
+./src/CpsSearch.d \
+./src/DirectMedia.d \
+./src/DisconnectStats.d \
+./src/Framework.d \
+./src/Isup.d \
+./src/IsupBodyCache.d \
+./src/LatencyHistogram.d \
+./src/LoopbackBench.d \
+./src/MetricsExporter.d \
+./src/NullMediaTransport.d \
+./src/PacketCapture.d \
+./src/PayloadCache.d \
+./src/RtpPacer.d \
+./src/RtpShards.d \
+./src/RtpStats.d \
+./src/SdpTemplates.d \
+./src/ShardSupervisor.d \
+./src/SipTransports.d \
+./src/TimerWheel.d 
 
 
 # Each subdirectory must supply rules for building sources it contributes
@@ -0,0 +1,366 @@
+#include "CallContext.h"
+
+#include <pjsua-lib/pjsua_internal.h>
+
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#define THIS_FILE "CALL_CONTEXT"
+
+LocalCallUserData* CallContextSlab::slots = NULL;
+unsigned CallContextSlab::capacity = 0;
+eSdpRetention CallContextSlab::retention = eSdpRetention::LAZY;
+char* CallContextSlab::sdpArena = NULL;
+size_t CallContextSlab::sdpBytes = 0;
+
+namespace {
+
+//a call whose hold timer has gone off - the generation guards against the slot having been reused since
+struct ExpiredCall
+{
+	pjsua_call_id call_id;
+	uint32_t generation;
+};
+
+std::unique_ptr<TimerWheel> wheel;
+std::thread timerThread;
+std::mutex timerMutex;
+std::condition_variable timerWakeup;
+bool timerStop = false;
+std::vector<ExpiredCall> expiredCalls; //only touched by the timer thread - keeps its capacity between ticks
+
+//take the dialog lock of whatever call now holds call_id, the way pjsua's own acquire_call does - PJSUA_LOCK only
+//long enough to read the dialog, and backing off rather than waiting on either lock, as the pjsua threads take them
+//the other way round. NULL if the call has gone, or the locks could not be had
+pjsip_dialog* lock_call_dialog(pjsua_call_id call_id)
+{
+	for (unsigned retry=0; retry<50; retry++)
+	{
+		if (PJSUA_TRY_LOCK() != PJ_SUCCESS)
+		{
+			pj_thread_sleep(retry/10);
+			continue;
+		}
+
+		pjsua_call* call = &pjsua_var.calls[call_id];
+		pjsip_dialog* dlg = call->inv ? call->inv->dlg : call->async_call.dlg;
+		if (!dlg)
+		{
+			PJSUA_UNLOCK();
+			return NULL;
+		}
+
+		if (pjsip_dlg_try_inc_lock(dlg) != PJ_SUCCESS)
+		{
+			PJSUA_UNLOCK();
+			pj_thread_sleep(retry/10);
+			continue;
+		}
+
+		PJSUA_UNLOCK();
+		return dlg;
+	}
+	return NULL;
+}
+
+}
+
+
+LocalCallUserData::LocalCallUserData():pool(NULL),callType(eCallType::UNINITIALISED),
+		simDir(eSimulatorDirectionType::SIMULATED_UNI_DIRECTIONAL),
+		agentDir(eAgentDirectionType::ANSWER_UNI_DIRECTIONAL),call_id(boost::none),confirmed(false),
+		invite_sent_us(0),answered_us(0),bye_sent_us(0),got_100(false),got_18x(false),
+		connection(-1),pool_invite_us(0),pool_bye_us(0),
+		inUse(false),generation(0),sdp(NULL),sdpVersion(0),sdpText(NULL),sdpTextLen(0)
+{
+	called_number[0] = 0;
+	hangupTimer.owner = this;
+}
+
+//back to the state of a freshly constructed context - without giving any memory back
+void LocalCallUserData::Reset()
+{
+	callType=eCallType::UNINITIALISED;
+	simDir=eSimulatorDirectionType::SIMULATED_UNI_DIRECTIONAL;
+	agentDir=eAgentDirectionType::ANSWER_UNI_DIRECTIONAL;
+	call_id=boost::none;
+	{
+		std::lock_guard<std::mutex> lock(sdpMutex);
+		sdp=NULL;
+		sdpTextLen=0;
+	}
+	confirmed=false;
+	called_number[0]=0;
+	invite_sent_us=0;
+	answered_us=0;
+	bye_sent_us=0;
+	got_100=false;
+	got_18x=false;
+	connection=-1;
+	pool_invite_us=0;
+	pool_bye_us=0;
+	pj_pool_reset(pool);
+}
+
+LocalCallUserData* LocalCallUserData::LookupByCall(pjsua_call_id call_id)
+{
+	return CallContextSlab::Lookup(call_id);
+}
+
+void LocalCallUserData::BindToCall(pjsua_call_id _call_id)
+{
+	call_id=_call_id;
+	pjsua_call_set_user_data (_call_id,this);
+}
+
+void LocalCallUserData::SaveSDP()
+{
+	if(call_id==boost::none)
+	{
+		std::cerr << "WTF - trying to save sdp in unbound call context";
+		exit(-1);
+	}
+
+	confirmed=true;
+
+	if (CallContextSlab::Retention() == +eSdpRetention::OFF)
+		return;
+
+	//called from the call's own callbacks - the dialog lock is held so the invite session cannot go away under us,
+	//and there is no need for PJSUA_LOCK
+	pjsip_inv_session* inv = pjsua_var.calls[call_id.get()].inv;
+	const pjmedia_sdp_session* active = NULL;
+
+	if (inv && inv->neg)
+		pjmedia_sdp_neg_get_active_local(inv->neg,&active);
+
+	//cloned while the dialog lock still pins the negotiator's session. The same session is seen more than once (the
+	//CONFIRMED state and the media update) so it is only copied when its o= version moves on - each re-INVITE that
+	//changes it leaves a copy in the pool until the call is released, a few hundred bytes a time
+	if (CallContextSlab::Retention() == +eSdpRetention::LAZY)
+	{
+		if (sdp && active && active->origin.version == sdpVersion)
+			return;
+
+		const pjmedia_sdp_session* copy = active ? pjmedia_sdp_session_clone(pool, active) : NULL;
+
+		std::lock_guard<std::mutex> lock(sdpMutex);
+		sdp=copy;
+		sdpVersion=copy ? copy->origin.version : 0;
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(sdpMutex);
+
+	//EAGER - straight into the slot's share of the arena, which is sized once for every call
+	sdpTextLen=0;
+	if (active)
+	{
+		int sz = pjmedia_sdp_print(active, sdpText, CallContextSlab::SdpBytes());
+		if (sz < 0 || (size_t)sz >= CallContextSlab::SdpBytes())
+			PJ_LOG(3,(THIS_FILE, "SDP of call %d does not fit in --sdp-bytes %lu", call_id.get(), CallContextSlab::SdpBytes()));
+		else
+			sdpTextLen=sz;
+	}
+}
+
+size_t LocalCallUserData::RenderSDP(char* buf, size_t len)
+{
+	std::lock_guard<std::mutex> lock(sdpMutex);
+
+	if (!len)
+		return 0;
+
+	if (sdpTextLen)
+	{
+		if (sdpTextLen >= len)
+			return 0;
+		memcpy(buf, sdpText, sdpTextLen);
+		buf[sdpTextLen]=0;
+		return sdpTextLen;
+	}
+
+	if (!sdp)
+		return 0;
+
+	int sz = pjmedia_sdp_print(sdp, buf, len);
+	if (sz < 0 || (size_t)sz >= len)
+	{
+		buf[0]=0;
+		return 0;
+	}
+
+	buf[sz]=0;
+	return sz;
+}
+
+void LocalCallUserData::SetHangupTimer(uint32_t msec_timeout)
+{
+	if(call_id==boost::none)
+	{
+		std::cerr << "WTF - trying to set timer on call object that is not initialised";
+		exit(-1);
+	}
+
+	//the timer node lives in the slot, so it is cancelled when the call goes away early and never outlives it
+	if (!wheel)
+	{
+		std::cerr << "WTF - trying to set a hangup timer before the timers are started";
+		exit(-1);
+	}
+	wheel->Arm(&hangupTimer, msec_timeout);
+}
+
+
+void CallContextSlab::Init(unsigned max_calls, eSdpRetention _retention, size_t sdp_bytes)
+{
+	void* mem;
+
+	if (slots)
+		return;
+
+	//the one and only allocation - cache line aligned so neighbouring calls on different threads do not share lines
+	if (posix_memalign(&mem, alignof(LocalCallUserData), sizeof(LocalCallUserData) * max_calls) != 0)
+	{
+		std::cerr << "WTF - cannot allocate call context slab for " << max_calls << " calls";
+		exit(-1);
+	}
+
+	slots = (LocalCallUserData*)mem;
+	capacity = max_calls;
+	retention = _retention;
+
+	//one arena for every call's SDP text rather than a buffer per call grown on demand
+	if (retention == +eSdpRetention::EAGER)
+	{
+		sdpBytes = sdp_bytes;
+		sdpArena = (char*)malloc(sdpBytes * max_calls);
+		if (!sdpArena)
+		{
+			std::cerr << "WTF - cannot allocate " << sdpBytes << " bytes of SDP for each of " << max_calls << " calls";
+			exit(-1);
+		}
+	}
+
+	for (unsigned i=0; i<capacity; i++)
+	{
+		LocalCallUserData* call = new (&slots[i]) LocalCallUserData;
+		call->pool = pjsua_pool_create("USER_CALL_%p", 512, 512);
+		if (sdpArena)
+			call->sdpText = sdpArena + sdpBytes * i;
+	}
+}
+
+LocalCallUserData* CallContextSlab::Acquire(pjsua_call_id call_id)
+{
+	if (call_id < 0 || (unsigned)call_id >= capacity)
+		return NULL;
+
+	LocalCallUserData* call = &slots[call_id];
+	if (call->inUse)
+	{
+		PJ_LOG(2,(THIS_FILE, "Reclaiming context for call %d", call_id));
+		Release(call);
+	}
+
+	call->generation++;
+	call->inUse = true;
+	return call;
+}
+
+LocalCallUserData* CallContextSlab::Lookup(pjsua_call_id call_id)
+{
+	if (call_id < 0 || (unsigned)call_id >= capacity || !slots[call_id].inUse)
+		return NULL;
+	return &slots[call_id];
+}
+
+void CallContextSlab::Release(LocalCallUserData* call)
+{
+	if (!call || !call->inUse)
+		return;
+
+	if (wheel)
+		wheel->Cancel(&call->hangupTimer);
+
+	call->inUse = false;
+	call->Reset();
+}
+
+void CallContextSlab::StartTimers(std::chrono::milliseconds tick)
+{
+	if (wheel)
+		return;
+
+	wheel.reset(new TimerWheel(tick));
+	expiredCalls.reserve(capacity);
+	timerStop = false;
+	timerThread = std::thread(&CallContextSlab::RunTimers);
+}
+
+void CallContextSlab::StopTimers()
+{
+	{
+		std::lock_guard<std::mutex> lock(timerMutex);
+		timerStop = true;
+	}
+	timerWakeup.notify_all();
+
+	if (timerThread.joinable())
+		timerThread.join();
+}
+
+//called under the wheel lock - just note the call, the hangups happen once the lock is dropped
+void CallContextSlab::TimerExpired(TimerNode* node, void* ctx)
+{
+	PJ_UNUSED_ARG(ctx);
+
+	LocalCallUserData* call = static_cast<CallTimer*>(node)->owner;
+	if (call->call_id != boost::none)
+	{
+		ExpiredCall expired = { call->call_id.get(), call->generation };
+		expiredCalls.push_back(expired);
+	}
+}
+
+void CallContextSlab::RunTimers()
+{
+	pj_thread_desc thread_desc;
+	pj_thread_t* thread;
+	pj_thread_register("call_timers", thread_desc, &thread);
+
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(timerMutex);
+			if (timerWakeup.wait_until(lock, wheel->NextTick(), []{ return timerStop; }))
+				break;
+		}
+
+		expiredCalls.clear();
+		wheel->Advance(TimerWheel::Clock::now(), &TimerExpired, NULL);
+
+		//hang up the whole batch outside the wheel lock - skipping any slot that has moved on to another call. The
+		//generation is checked under the dialog lock of the call holding the id: the context is released, and the id
+		//handed on, only under that lock, so the call we hang up is the one the timer was set for
+		for (auto& expired : expiredCalls)
+		{
+			pjsip_dialog* dlg = lock_call_dialog(expired.call_id);
+			if (!dlg)
+				continue;
+
+			LocalCallUserData* call = Lookup(expired.call_id);
+			if (call && call->generation == expired.generation)
+				pjsua_call_hangup(expired.call_id,200,0,0);
+
+			pjsip_dlg_dec_lock(dlg);
+		}
+	}
+}
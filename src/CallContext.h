@@ -0,0 +1,133 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+#include <boost/optional.hpp>
+
+#include "Enum.h"
+#include "TimerWheel.h"
+
+ENUM(eCallType, uint16_t, UNINITIALISED, SIMULATED_AXE_CALL_OFFER, SIMULATED_S10_CALL_OFFER, RECEIVED_CALL );
+ENUM(eSimulatorDirectionType, uint16_t, SIMULATED_UNI_DIRECTIONAL, SIMULATE_BI_DIRECTIONAL);
+ENUM(eAgentDirectionType, uint16_t,  ANSWER_UNI_DIRECTIONAL, ANSWER_BI_DIRECTIONAL );
+
+//what is kept of a confirmed call's SDP for the 'l' command - nothing, a copy of the negotiated session that is
+//printed when asked for, or the text printed as the call is confirmed
+ENUM(eSdpRetention, uint16_t, OFF, LAZY, EAGER);
+
+//what the client wants of a call it is about to place. The call context is indexed by call id, which pjsua only
+//picks inside pjsua_call_make_call - so this rides along as the pjsua user data and on_call_sdp_created (which
+//pjsua calls before make_call returns) uses it to set up the context
+struct OutgoingCallRequest
+{
+	eCallType callType;
+	eSimulatorDirectionType simDir;
+	uint32_t hold_ms;
+	unsigned connection; //which of the ConnectionPool connections it goes over
+};
+
+class LocalCallUserData;
+
+//hold timer node that knows which call context it belongs to
+struct CallTimer : public TimerNode
+{
+	LocalCallUserData* owner;
+};
+
+//grab bag for anything required on a per call basis - sorta C/C++ halfway house of yuk...
+//these live in a slab built at startup, one per possible pjsua call id, and are recycled rather than new'd and
+//deleted - nothing on call setup or teardown touches the heap
+class alignas(64) LocalCallUserData {
+public:
+	pj_pool_t* pool;     //belongs to the slot - reset, not released, when the call ends
+	eCallType  callType;
+	eSimulatorDirectionType simDir;
+	eAgentDirectionType agentDir;
+	boost::optional<pjsua_call_id> call_id;
+	bool confirmed;
+	char called_number[32]; //from the received IAM - empty for calls we placed
+
+	//signalling milestones in CallLatency::Now() microseconds - 0 until they happen
+	uint64_t invite_sent_us;  //calls we placed only
+	uint64_t answered_us;     //200 OK to the INVITE sent or received
+	uint64_t bye_sent_us;
+	bool     got_100;
+	bool     got_18x;
+
+	int      connection;      //ConnectionPool connection of a call we placed, -1 for received calls
+	uint64_t pool_invite_us;  //when the INVITE / BYE now awaiting a response went out over that connection - 0 if none
+	uint64_t pool_bye_us;
+
+	LocalCallUserData();
+
+	static LocalCallUserData* LookupByCall(pjsua_call_id call_id);
+
+	void BindToCall(pjsua_call_id _call_id);
+
+	//keep the negotiated local SDP of the call as the slab's eSdpRetention says - from the call's own callbacks, with
+	//the dialog lock held
+	void SaveSDP();
+
+	//print the SDP saved for the call into buf, NUL terminated. Returns the length, or 0 if there is none or it does
+	//not fit
+	size_t RenderSDP(char* buf, size_t len);
+
+	void SetHangupTimer(uint32_t msec_timeout);
+
+private:
+	friend class CallContextSlab;
+
+	void Reset();
+
+	std::atomic<bool> inUse;
+	std::atomic<uint32_t> generation; //bumped every time the slot is claimed, so a stale timer can tell it is stale
+	CallTimer hangupTimer;
+
+	//a clone in the slot's own pool - pjsip recycles the negotiator's pools on a re-INVITE, so a pointer into them
+	//could be freed under the 'l' command. Good until the call is released, which clears it under the same lock
+	std::mutex sdpMutex;
+	const pjmedia_sdp_session* sdp;  //LAZY
+	pj_uint32_t sdpVersion;          //o= version of the session sdp was cloned from
+	char*  sdpText;                  //EAGER - this slot's share of the slab's SDP arena
+	size_t sdpTextLen;               //0 when nothing has been captured
+};
+
+//fixed capacity store of call contexts, indexed by pjsua_call_id
+class CallContextSlab {
+public:
+	//size the slab from max_calls and give every slot its pool - call after pjsua_init(). With EAGER retention each
+	//slot also gets sdp_bytes of one arena to print its SDP into
+	static void Init(unsigned max_calls, eSdpRetention retention, size_t sdp_bytes);
+
+	//claim the slot for call_id. pjsua only hands out an id once the previous call using it is gone, so a slot
+	//still marked in use belonged to a call that never got as far as DISCONNECTED - it is reclaimed
+	static LocalCallUserData* Acquire(pjsua_call_id call_id);
+
+	static LocalCallUserData* Lookup(pjsua_call_id call_id);
+
+	//cancel anything still pending on the context and hand the slot back
+	static void Release(LocalCallUserData* call);
+
+	static unsigned Capacity() { return capacity; }
+	static eSdpRetention Retention() { return retention; }
+	static size_t SdpBytes() { return sdpBytes; }
+
+	//hold timers run off a timer wheel driven by a thread of our own, rather than one pjsua timer heap entry per call
+	static void StartTimers(std::chrono::milliseconds tick);
+	static void StopTimers();
+
+private:
+	static void RunTimers();
+	static void TimerExpired(TimerNode* node, void* ctx);
+
+	static LocalCallUserData* slots;
+	static unsigned capacity;
+	static eSdpRetention retention;
+	static char* sdpArena;
+	static size_t sdpBytes;  //per slot
+};
@@ -0,0 +1,217 @@
+#include "CallGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+bool CallGeneratorConfig::ParseBurstScript(const std::string& script, std::vector<BurstEvent>& bursts)
+{
+	std::istringstream events(script);
+	std::string event;
+
+	bursts.clear();
+	while (std::getline(events, event, ','))
+	{
+		BurstEvent burst = { 0.0, 0, 0.0 };
+		char* end;
+		const char* p = event.c_str();
+
+		burst.offset_sec = strtod(p, &end);
+		if (end == p || *end != ':' || burst.offset_sec < 0.0)
+			return false;
+
+		p = end + 1;
+		burst.count = strtoul(p, &end, 10);
+		if (end == p || (*end != ':' && *end != 0) || burst.count == 0)
+			return false;
+
+		if (*end == ':')
+		{
+			p = end + 1;
+			burst.spread_ms = strtod(p, &end);
+			if (end == p || *end != 0 || burst.spread_ms < 0.0)
+				return false;
+		}
+		bursts.push_back(burst);
+	}
+
+	std::sort(bursts.begin(), bursts.end(),
+			[](const BurstEvent& a, const BurstEvent& b) { return a.offset_sec < b.offset_sec; });
+	return !bursts.empty();
+}
+
+CallGenerator::CallGenerator(const CallGeneratorConfig& _cfg, PlaceCallFn _placeCall, ActiveCallsFn _activeCalls):
+		cfg(_cfg),placeCall(_placeCall),activeCalls(_activeCalls),
+		seed(_cfg.seed ? _cfg.seed : std::random_device()()),
+		burstIdx(0),burstCallIdx(0),burstCycle(0),stopRequested(false),
+		running(false),attempts(0),failed(0),suppressed(0),late(0)
+{
+	std::seed_seq arrivalSeed{ seed, (uint64_t)1 };
+	std::seed_seq holdSeed{ seed, (uint64_t)2 };
+	arrivalRng.seed(arrivalSeed);
+	holdRng.seed(holdSeed);
+}
+
+CallGenerator::~CallGenerator()
+{
+	Stop();
+}
+
+void CallGenerator::Start()
+{
+	if (running)
+		return;
+	if (cfg.cps <= 0.0 && (cfg.arrival != +eArrivalModel::BURST || cfg.bursts.empty()))
+		return;
+
+	stopRequested=false;
+	running=true;
+	thread = std::thread(&CallGenerator::Run,this);
+}
+
+void CallGenerator::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopRequested=true;
+	}
+	wakeup.notify_all();
+
+	if (thread.joinable())
+		thread.join();
+}
+
+//the number of calls due by time t is the integral of the rate profile - a linear ramp up to cps followed by a
+//flat line. The n'th call is due at the time that integral reaches n, so the schedule is exact however long the run.
+//Feeding in a running sum of unit exponentials instead of 0,1,2... turns the same profile into a Poisson process
+CallGenerator::Clock::duration CallGenerator::DueOffset(double n) const
+{
+	double ramp_calls = cfg.cps * cfg.ramp_up_sec / 2.0; //calls placed during the ramp
+	double t;
+
+	if (n < ramp_calls)
+		t = std::sqrt(2.0 * n * cfg.ramp_up_sec / cfg.cps);
+	else
+		t = cfg.ramp_up_sec + (n - ramp_calls) / cfg.cps;
+
+	return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(t));
+}
+
+//offset of the next call in the burst script - Clock::duration::max() once the script has been played out
+CallGenerator::Clock::duration CallGenerator::NextBurstOffset()
+{
+	size_t skipped = 0;
+
+	while (burstIdx < cfg.bursts.size() && burstCallIdx >= cfg.bursts[burstIdx].count)
+	{
+		//a whole cycle without a call in it would have us wrapping round forever - there is nothing to play
+		if (++skipped > cfg.bursts.size())
+		{
+			burstIdx = cfg.bursts.size();
+			break;
+		}
+
+		burstCallIdx=0;
+		if (++burstIdx == cfg.bursts.size() && cfg.burst_period_sec > 0.0)
+		{
+			burstIdx=0;
+			burstCycle++;
+		}
+	}
+
+	if (burstIdx >= cfg.bursts.size())
+		return Clock::duration::max();
+
+	const BurstEvent& burst = cfg.bursts[burstIdx];
+	double t = burstCycle * cfg.burst_period_sec + burst.offset_sec +
+			burst.spread_ms / 1000.0 * burstCallIdx / burst.count;
+
+	return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(t));
+}
+
+uint32_t CallGenerator::NextHoldMs()
+{
+	double hold;
+
+	switch (cfg.holdDist)
+	{
+	case eHoldDistribution::EXPONENTIAL :
+		hold = std::exponential_distribution<double>(1.0 / cfg.hold_mean_sec)(holdRng);
+		break;
+	case eHoldDistribution::UNIFORM :
+		hold = std::uniform_real_distribution<double>(cfg.hold_min_sec, cfg.hold_max_sec)(holdRng);
+		break;
+	case eHoldDistribution::LOGNORMAL :
+		//pick mu so that the mean of the distribution is hold_mean_sec
+		hold = std::lognormal_distribution<double>(std::log(cfg.hold_mean_sec) - cfg.hold_sigma * cfg.hold_sigma / 2.0,
+				cfg.hold_sigma)(holdRng);
+		break;
+	case eHoldDistribution::FIXED :
+	default:
+		hold = cfg.hold_mean_sec;
+		break;
+	}
+
+	hold = std::min(std::max(hold, cfg.hold_min_sec), cfg.hold_max_sec);
+	return (uint32_t)(hold * 1000.0);
+}
+
+void CallGenerator::Run()
+{
+	const Clock::time_point start = Clock::now();
+	const bool useBase = cfg.cps > 0.0;
+	const bool useBursts = cfg.arrival == +eArrivalModel::BURST;
+
+	std::exponential_distribution<double> unitExp(1.0);
+	double baseN = 0.0;
+
+	if (useBase && cfg.arrival == +eArrivalModel::POISSON)
+		baseN = unitExp(arrivalRng);
+
+	Clock::duration nextBase = useBase ? DueOffset(baseN) : Clock::duration::max();
+	Clock::duration nextBurst = useBursts ? NextBurstOffset() : Clock::duration::max();
+
+	while (cfg.total_calls == 0 || attempts + failed < cfg.total_calls)
+	{
+		if (nextBase == Clock::duration::max() && nextBurst == Clock::duration::max())
+			break; //burst script finished and there is no base rate
+
+		//take whichever schedule is due first and advance it
+		Clock::time_point due;
+		if (nextBurst < nextBase)
+		{
+			due = start + nextBurst;
+			burstCallIdx++;
+			nextBurst = NextBurstOffset();
+		}
+		else
+		{
+			due = start + nextBase;
+			baseN += cfg.arrival == +eArrivalModel::POISSON ? unitExp(arrivalRng) : 1.0;
+			nextBase = DueOffset(baseN);
+		}
+
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			if (wakeup.wait_until(lock, due, [this]{ return stopRequested; }))
+				break;
+		}
+
+		if (Clock::now() - due > std::chrono::milliseconds(1))
+			late++;
+
+		if (cfg.max_concurrent && activeCalls() >= cfg.max_concurrent)
+		{
+			suppressed++;
+			continue;
+		}
+
+		if (placeCall(NextHoldMs()))
+			attempts++;
+		else
+			failed++;
+	}
+
+	running=false;
+}
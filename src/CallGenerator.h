@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Enum.h"
+
+//how call attempts are spaced out
+//CONSTANT - evenly spaced at the configured rate
+//POISSON  - exponential inter arrival times with the configured rate as the mean
+//BURST    - the CONSTANT schedule with scripted bursts of calls layered on top
+ENUM(eArrivalModel, uint16_t, CONSTANT, POISSON, BURST);
+
+//how long a placed call is held before we hang it up
+ENUM(eHoldDistribution, uint16_t, FIXED, EXPONENTIAL, UNIFORM, LOGNORMAL);
+
+//a scripted burst - count calls offered at offset seconds into the run, spread evenly over spread_ms
+struct BurstEvent
+{
+	double   offset_sec;
+	uint32_t count;
+	double   spread_ms;
+};
+
+//settings for the outgoing call generator - all of these come straight off the command line
+struct CallGeneratorConfig
+{
+	double   cps;            //target calls per second once the ramp has completed
+	double   ramp_up_sec;    //time taken to ramp linearly from 0 to cps - 0 means start at full rate
+	uint64_t total_calls;    //stop after this many call attempts - 0 means run until stopped
+	uint32_t max_concurrent; //do not offer a new call while this many are in progress - 0 means no limit
+
+	eArrivalModel arrival;
+	uint64_t seed;           //0 picks a random seed - either way Seed() reports the one in use so a run can be repeated
+
+	std::vector<BurstEvent> bursts;
+	double   burst_period_sec; //repeat the burst script with this period - 0 means play it once
+
+	eHoldDistribution holdDist;
+	double   hold_mean_sec;  //FIXED, EXPONENTIAL and LOGNORMAL
+	double   hold_min_sec;   //UNIFORM range, and a clamp for the others
+	double   hold_max_sec;
+	double   hold_sigma;     //LOGNORMAL shape
+
+	CallGeneratorConfig():cps(2.0),ramp_up_sec(0.0),total_calls(150),max_concurrent(0),
+			arrival(eArrivalModel::CONSTANT),seed(0),burst_period_sec(0.0),
+			holdDist(eHoldDistribution::FIXED),hold_mean_sec(300.0),hold_min_sec(0.0),hold_max_sec(86400.0),hold_sigma(1.0) {}
+
+	//script format is offset_sec:count[:spread_ms][,offset_sec:count[:spread_ms]...]
+	static bool ParseBurstScript(const std::string& script, std::vector<BurstEvent>& bursts);
+};
+
+//open loop call generator - attempt n is due at a fixed offset from the start time worked out from the
+//configured rate profile, NOT from when attempt n-1 completed. If placing a call stalls we catch up
+//rather than quietly lowering the offered load.
+//
+//the generator knows nothing about pjsua - the framework hands it a function that places one call
+//and a function that reports how many calls are currently in progress
+class CallGenerator {
+public:
+	typedef std::function<bool(uint32_t hold_ms)> PlaceCallFn; //returns false if the call could not be placed
+	typedef std::function<uint32_t(void)> ActiveCallsFn;
+
+	typedef std::chrono::steady_clock Clock;
+
+	CallGenerator(const CallGeneratorConfig& cfg, PlaceCallFn placeCall, ActiveCallsFn activeCalls);
+	~CallGenerator();
+
+	void Start();
+	void Stop();   //safe to call more than once, blocks until the scheduling thread has exited
+
+	bool Running() const { return running; }
+	uint64_t Seed() const { return seed; }
+
+	uint64_t Attempts() const { return attempts; }     //calls handed to the stack
+	uint64_t Failed() const { return failed; }         //calls the stack refused to place
+	uint64_t Suppressed() const { return suppressed; } //schedule slots skipped because of the concurrency limit
+	uint64_t Late() const { return late; }             //attempts issued more than 1ms after they were due
+
+	//offset from the start of the run at which the rate profile has offered n calls
+	Clock::duration DueOffset(double n) const;
+
+	//draw a hold time from the configured distribution
+	uint32_t NextHoldMs();
+
+private:
+	void Run();
+	Clock::duration NextBurstOffset();
+
+	CallGeneratorConfig cfg;
+	PlaceCallFn placeCall;
+	ActiveCallsFn activeCalls;
+
+	uint64_t seed;
+	std::mt19937_64 arrivalRng; //separate streams so changing the hold distribution does not move the arrivals
+	std::mt19937_64 holdRng;
+
+	//burst script playback position
+	size_t burstIdx;
+	uint32_t burstCallIdx;
+	uint64_t burstCycle;
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	bool stopRequested;
+
+	std::atomic<bool> running;
+	std::atomic<uint64_t> attempts;
+	std::atomic<uint64_t> failed;
+	std::atomic<uint64_t> suppressed;
+	std::atomic<uint64_t> late;
+};
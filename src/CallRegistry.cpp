@@ -0,0 +1,148 @@
+#include "CallRegistry.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#include "LatencyHistogram.h"
+
+CallRegistry::Slot* CallRegistry::slots = NULL;
+unsigned CallRegistry::capacity = 0;
+
+//copy a pj_str_t into a fixed buffer, truncating if need be
+static void copy_str(char* dst, size_t len, const pj_str_t& src)
+{
+	size_t n = (size_t)src.slen < len - 1 ? (size_t)src.slen : len - 1;
+
+	memcpy(dst, src.ptr, n);
+	dst[n] = 0;
+}
+
+void CallRegistry::Init(unsigned max_calls)
+{
+	void* mem;
+
+	if (slots)
+		return;
+
+	if (posix_memalign(&mem, alignof(Slot), sizeof(Slot) * max_calls) != 0)
+	{
+		std::cerr << "WTF - cannot allocate call registry for " << max_calls << " calls";
+		exit(-1);
+	}
+
+	slots = (Slot*)mem;
+	for (unsigned i=0; i<max_calls; i++)
+	{
+		new (&slots[i]) Slot();
+		slots[i].record.call_id = i;
+	}
+	capacity = max_calls;
+}
+
+CallRecord* CallRegistry::BeginWrite(pjsua_call_id call_id)
+{
+	if (call_id < 0 || (unsigned)call_id >= capacity)
+		return NULL;
+
+	Slot& slot = slots[call_id];
+	slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	return &slot.record;
+}
+
+void CallRegistry::EndWrite(pjsua_call_id call_id)
+{
+	Slot& slot = slots[call_id];
+	slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void CallRegistry::Update(const pjsua_call_info& ci, const LocalCallUserData* call)
+{
+	CallRecord* record = BeginWrite(ci.id);
+	if (!record)
+		return;
+
+	if (!record->active)
+	{
+		record->active = true;
+		record->start_us = CallLatency::Now();
+		record->connect_us = 0;
+		record->media_status = PJSUA_CALL_MEDIA_NONE;
+		record->media_dir = PJMEDIA_DIR_NONE;
+		copy_str(record->local_uri, sizeof(record->local_uri), ci.local_info);
+		copy_str(record->remote_uri, sizeof(record->remote_uri), ci.remote_info);
+		copy_str(record->sip_call_id, sizeof(record->sip_call_id), ci.call_id);
+	}
+
+	record->state = ci.state;
+	record->last_status = ci.last_status;
+	if (ci.state == PJSIP_INV_STATE_CONFIRMED && !record->connect_us)
+		record->connect_us = CallLatency::Now();
+
+	//the context is set up after the first callbacks for a received call - so keep picking these up
+	record->call_type = call ? call->callType._to_integral() : (+eCallType::UNINITIALISED)._to_integral();
+	if (call)
+		strcpy(record->called_number, call->called_number);
+	else
+		record->called_number[0] = 0;
+
+	EndWrite(ci.id);
+}
+
+void CallRegistry::UpdateMedia(pjsua_call_id call_id, pjsua_call_media_status status, pjmedia_dir dir)
+{
+	CallRecord* record = BeginWrite(call_id);
+	if (!record)
+		return;
+
+	record->media_status = status;
+	record->media_dir = dir;
+
+	EndWrite(call_id);
+}
+
+void CallRegistry::Remove(pjsua_call_id call_id)
+{
+	CallRecord* record = BeginWrite(call_id);
+	if (!record)
+		return;
+
+	record->active = false;
+
+	EndWrite(call_id);
+}
+
+bool CallRegistry::Read(pjsua_call_id call_id, CallRecord& record)
+{
+	if (call_id < 0 || (unsigned)call_id >= capacity)
+		return false;
+
+	const Slot& slot = slots[call_id];
+	uint32_t before, after;
+
+	do
+	{
+		before = slot.seq.load(std::memory_order_acquire);
+		if (before & 1)
+			continue;
+		memcpy(&record, &slot.record, sizeof(record));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		after = slot.seq.load(std::memory_order_relaxed);
+	} while ((before & 1) || before != after);
+
+	return record.active;
+}
+
+void CallRegistry::Snapshot(std::vector<CallRecord>& records)
+{
+	CallRecord record;
+
+	records.clear();
+	for (unsigned i=0; i<capacity; i++)
+	{
+		if (Read(i, record))
+			records.push_back(record);
+	}
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "CallContext.h"
+
+//what we know about a call - plain data, copied out whole
+struct CallRecord
+{
+	pjsua_call_id call_id;
+	bool          active;
+	uint16_t      call_type;     //eCallType
+	pjsip_inv_state state;
+	int           last_status;
+	pjsua_call_media_status media_status;
+	pjmedia_dir   media_dir;
+	uint64_t      start_us;      //CallLatency::Now() when we first saw the call
+	uint64_t      connect_us;    //and when it was confirmed - 0 if it has not been
+	char          local_uri[128];
+	char          remote_uri[128];
+	char          sip_call_id[128];
+	char          called_number[32];
+};
+
+//a record per call id kept up to date from the call callbacks, so listing calls never needs pjsua. Each slot is
+//a seqlock: the callbacks for a call are serialised by its dialog lock, so there is only ever one writer, and it
+//never waits. Readers copy the record and go round again if the writer was in there at the same time
+class CallRegistry {
+public:
+	//call after pjsua_init() - max_calls as configured there
+	static void Init(unsigned max_calls);
+
+	//from on_call_state - ci is what the callback has just fetched, call the context if there is one
+	static void Update(const pjsua_call_info& ci, const LocalCallUserData* call);
+
+	//from on_call_media_state
+	static void UpdateMedia(pjsua_call_id call_id, pjsua_call_media_status status, pjmedia_dir dir);
+
+	//from on_call_state once the call is DISCONNECTED
+	static void Remove(pjsua_call_id call_id);
+
+	//consistent copy of one call - false if there is no such call
+	static bool Read(pjsua_call_id call_id, CallRecord& record);
+
+	//consistent copy of every active call, in call id order. Only the records are consistent - calls may come and
+	//go while we walk the table
+	static void Snapshot(std::vector<CallRecord>& records);
+
+private:
+	struct alignas(64) Slot
+	{
+		std::atomic<uint32_t> seq; //odd while the record is being written
+		CallRecord record;
+	};
+
+	static CallRecord* BeginWrite(pjsua_call_id call_id);
+	static void EndWrite(pjsua_call_id call_id);
+
+	static Slot* slots;
+	static unsigned capacity;
+};
@@ -0,0 +1,163 @@
+#include "ConnectionPool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+
+#define SIP_DOMAIN "127.0.0.1"
+
+ConnectionPool::Connection* ConnectionPool::connections = NULL;
+unsigned ConnectionPool::size = 0;
+eConnectionPooling ConnectionPool::mode = eConnectionPooling::SHARED;
+unsigned ConnectionPool::callsPerConnection = 1;
+
+//the histograms make these big - no more than this many
+static const unsigned MAX_CONNECTIONS = 1024;
+
+void ConnectionPool::Init(eConnectionPooling _mode, unsigned count, unsigned calls_per_connection, unsigned max_calls,
+		eSipTransport type, const TlsFiles& tls, pjsua_acc_id shared_acc, unsigned rtp_port, unsigned rtp_ports)
+{
+	mode = _mode;
+	callsPerConnection = calls_per_connection ? calls_per_connection : 1;
+
+	switch (mode)
+	{
+	case eConnectionPooling::SHARED:
+		size = 1;
+		break;
+	case eConnectionPooling::FIXED:
+		size = count ? count : 1;
+		break;
+	case eConnectionPooling::PER_CALLS:
+		size = (max_calls + callsPerConnection - 1) / callsPerConnection;
+		break;
+	}
+
+	if (size > MAX_CONNECTIONS)
+	{
+		std::cerr << "WTF - " << size << " connections is more than the " << MAX_CONNECTIONS << " we can pool" << std::endl;
+		exit(-1);
+	}
+	if (size > 1 && type == +eSipTransport::UDP)
+	{
+		std::cerr << "WTF - connection pooling needs a connection oriented transport, not UDP" << std::endl;
+		exit(-1);
+	}
+
+	void* mem;
+	if (posix_memalign(&mem, alignof(Connection), sizeof(Connection) * size) != 0)
+	{
+		std::cerr << "WTF - cannot allocate " << size << " pooled connections" << std::endl;
+		exit(-1);
+	}
+	connections = (Connection*)mem;
+	for (unsigned i=0; i<size; i++)
+		new (&connections[i]) Connection(); //value initialised - the counters start at 0
+
+	//a single connection is just the one pjsip would open anyway - no need for a listener of its own
+	if (size == 1)
+	{
+		connections[0].acc = shared_acc;
+		connections[0].port = 0;
+		return;
+	}
+
+	for (unsigned i=0; i<size; i++)
+	{
+		//port 0 - let the kernel pick, we only need the listener to be distinct
+		pjsua_transport_id tp = SipTransports::Listen(type, 0, tls, false);
+		pjsua_transport_info info;
+		if (pjsua_transport_get_info(tp, &info) != PJ_SUCCESS)
+			info.local_name.port = 0;
+
+		std::string id = "sip:conn" + std::to_string(i) + "@" SIP_DOMAIN;
+		pjsua_acc_config cfg;
+		pjsua_acc_config_default(&cfg);
+		cfg.id = pj_str((char*)id.c_str()); //pjsua_acc_add copies the config
+		cfg.transport_id = tp;
+
+		//each account hunts for RTP ports from its own starting point, so split the range or they all collide
+		cfg.rtp_cfg.port = rtp_port + ((i * (rtp_ports / size)) & ~1u);
+
+		if (pjsua_acc_add(&cfg, PJ_FALSE, &connections[i].acc) != PJ_SUCCESS)
+		{
+			std::cerr << "WTF - cannot add account for pooled connection " << i << std::endl;
+			exit(-1);
+		}
+		connections[i].port = info.local_name.port;
+	}
+
+	printf("Pooling calls over %u %s connections\n", size, type._to_string());
+}
+
+unsigned ConnectionPool::Pick(uint64_t call_seq)
+{
+	unsigned connection = 0;
+
+	switch (mode)
+	{
+	case eConnectionPooling::SHARED:
+		connection = 0;
+		break;
+	case eConnectionPooling::FIXED:
+		connection = call_seq % size;
+		break;
+	case eConnectionPooling::PER_CALLS:
+		connection = (call_seq / callsPerConnection) % size;
+		break;
+	}
+
+	connections[connection].calls.fetch_add(1, std::memory_order_relaxed);
+	return connection;
+}
+
+pjsua_acc_id ConnectionPool::Account(unsigned connection)
+{
+	return connections[connection].acc;
+}
+
+void ConnectionPool::RequestSent(unsigned connection)
+{
+	Connection& c = connections[connection];
+
+	c.sent.fetch_add(1, std::memory_order_relaxed);
+	int64_t depth = c.in_flight.fetch_add(1, std::memory_order_relaxed) + 1;
+
+	int64_t seen = c.max_in_flight.load(std::memory_order_relaxed);
+	while (depth > seen && !c.max_in_flight.compare_exchange_weak(seen, depth, std::memory_order_relaxed))
+		;
+}
+
+void ConnectionPool::ResponseReceived(unsigned connection, uint64_t latency_us)
+{
+	connections[connection].in_flight.fetch_sub(1, std::memory_order_relaxed);
+	connections[connection].latency.Record(latency_us);
+}
+
+void ConnectionPool::RequestAbandoned(unsigned connection)
+{
+	connections[connection].in_flight.fetch_sub(1, std::memory_order_relaxed);
+	connections[connection].abandoned.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ConnectionPool::Print()
+{
+	std::unique_ptr<LatencyHistogram::Snapshot> latency(new LatencyHistogram::Snapshot);
+
+	printf("Conn  local port      calls   requests  in flight   max  abandoned  response (us) p50      p99     max\n");
+	for (unsigned i=0; i<size; i++)
+	{
+		Connection& c = connections[i];
+
+		latency->Clear();
+		c.latency.MergeInto(*latency);
+		printf("%4u %11u %10lu %10lu %10ld %5ld %10lu %19lu %8lu %8lu\n", i, c.port,
+				c.calls.load(std::memory_order_relaxed), c.sent.load(std::memory_order_relaxed),
+				c.in_flight.load(std::memory_order_relaxed), c.max_in_flight.load(std::memory_order_relaxed),
+				c.abandoned.load(std::memory_order_relaxed),
+				latency->Percentile(0.5), latency->Percentile(0.99), latency->max);
+	}
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "Enum.h"
+#include "LatencyHistogram.h"
+#include "SipTransports.h"
+
+//how the client spreads its calls over connections to the far end
+//SHARED    - everything over the one connection pjsip opens to the destination
+//FIXED     - round robin over a fixed number of connections
+//PER_CALLS - a new connection for every N calls placed, round robin once max-calls worth are open
+ENUM(eConnectionPooling, uint16_t, SHARED, FIXED, PER_CALLS);
+
+//pjsip keeps one connection per destination for each listener, so a pool of connections is a pool of listeners -
+//each on a port of its own with an account bound to it, and a call placed through that account goes over that
+//listener's connection.
+//
+//pjsip does not let us at the transport's send queue, so what we report per connection is what we can see: the
+//number of requests sent that have yet to hear any response - the depth of the queue as the far end sees it -
+//and the time from sending a request to the first response coming back
+class ConnectionPool {
+public:
+	//call once pjsua is started. rtp_port/rtp_ports is the range of RTP ports to share between the accounts
+	static void Init(eConnectionPooling mode, unsigned connections, unsigned calls_per_connection, unsigned max_calls,
+			eSipTransport type, const TlsFiles& tls, pjsua_acc_id shared_acc, unsigned rtp_port, unsigned rtp_ports);
+
+	static unsigned Size() { return size; }
+
+	//the connection the call_seq'th call goes over
+	static unsigned Pick(uint64_t call_seq);
+
+	static pjsua_acc_id Account(unsigned connection);
+
+	//request went out, or it heard back (latency_us after it went out), or it never will
+	static void RequestSent(unsigned connection);
+	static void ResponseReceived(unsigned connection, uint64_t latency_us);
+	static void RequestAbandoned(unsigned connection);
+
+	static void Print();
+
+private:
+	struct alignas(64) Connection
+	{
+		pjsua_acc_id acc;
+		unsigned port;
+		std::atomic<uint64_t> calls;
+		std::atomic<uint64_t> sent;
+		std::atomic<uint64_t> abandoned;
+		std::atomic<int64_t> in_flight;
+		std::atomic<int64_t> max_in_flight;
+		LatencyHistogram latency;
+	};
+
+	static Connection* connections;
+	static unsigned size;
+	static eConnectionPooling mode;
+	static unsigned callsPerConnection;
+};
@@ -0,0 +1,120 @@
+#include "CpsSearch.h"
+#include "DisconnectStats.h"
+#include "LatencyHistogram.h"
+
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+CpsSearch::CpsSearch(const CpsSearchConfig& _cfg, const CallGeneratorConfig& gen_cfg,
+		CallGenerator::PlaceCallFn _placeCall, CallGenerator::ActiveCallsFn _activeCalls, AnsweredFn _answered):
+		cfg(_cfg),genCfg(gen_cfg),placeCall(_placeCall),activeCalls(_activeCalls),answered(_answered),best(0)
+{
+	//every step runs for the window at a flat rate - the limits and shaping of a fixed run do not apply
+	genCfg.total_calls = 0;
+	genCfg.ramp_up_sec = 0;
+	genCfg.arrival = eArrivalModel::CONSTANT;
+	genCfg.bursts.clear();
+}
+
+CpsStep CpsSearch::RunStep(double cps)
+{
+	CpsStep step;
+	std::unique_ptr<DisconnectStats::Snapshot> clearedBefore(new DisconnectStats::Snapshot);
+	std::unique_ptr<DisconnectStats::Snapshot> clearedAfter(new DisconnectStats::Snapshot);
+	std::unique_ptr<LatencyHistogram::Snapshot> latencyBefore(new LatencyHistogram::Snapshot);
+	std::unique_ptr<LatencyHistogram::Snapshot> latency(new LatencyHistogram::Snapshot);
+
+	DisconnectStats::Take(*clearedBefore);
+	CallLatency::Take(eLatencyMilestone::INVITE_200, *latencyBefore);
+	uint64_t answeredBefore = answered();
+
+	genCfg.cps = cps;
+	{
+		CallGenerator generator(genCfg, placeCall, activeCalls);
+		generator.Start();
+		std::this_thread::sleep_for(cfg.window);
+		generator.Stop();
+
+		step.attempts = generator.Attempts();
+		step.failed = generator.Failed();
+	}
+
+	DisconnectStats::Take(*clearedAfter);
+	CallLatency::Take(eLatencyMilestone::INVITE_200, *latency);
+	latency->Subtract(*latencyBefore);
+
+	//calls cleared in the window - a long hold time pushes some of a rate's failures into the next window, so keep
+	//the hold time well inside it
+	for (unsigned code=0; code<DisconnectStats::CODES; code++)
+	{
+		if (code / 100 != 2)
+			step.failed += clearedAfter->ByCode(code) - clearedBefore->ByCode(code);
+	}
+
+	step.offered_cps = cps;
+	step.answered = answered() - answeredBefore;
+	step.fail_pct = step.attempts ? 100.0 * step.failed / step.attempts : 100.0;
+	step.p50_us = latency->Percentile(0.5);
+	step.p99_us = latency->Percentile(0.99);
+	step.pass = step.attempts > 0 && step.fail_pct <= cfg.slo_fail_pct && step.p99_us <= cfg.slo_p99_ms * 1000;
+
+	printf("%9.1f cps: attempts %lu answered %lu failed %lu (%.2f%%) INVITE->200 p50 %luus p99 %luus - %s\n",
+			cps, step.attempts, step.answered, step.failed, step.fail_pct, step.p50_us, step.p99_us,
+			step.pass ? "pass" : "FAIL");
+	fflush(stdout);
+	return step;
+}
+
+double CpsSearch::Run()
+{
+	double good = 0;
+	double bad = 0;
+	double cps = cfg.start_cps;
+
+	//climb until a rate fails
+	while (cps <= cfg.max_cps)
+	{
+		CpsStep step = RunStep(cps);
+		steps.push_back(step);
+		if (!step.pass)
+		{
+			bad = cps;
+			break;
+		}
+		good = cps;
+		cps *= cfg.factor;
+	}
+
+	//then close in on where it starts failing
+	while (bad > 0 && good > 0 && (bad - good) > good * cfg.precision)
+	{
+		cps = (good + bad) / 2;
+		CpsStep step = RunStep(cps);
+		steps.push_back(step);
+		if (step.pass)
+			good = cps;
+		else
+			bad = cps;
+	}
+
+	best = good;
+	return best;
+}
+
+void CpsSearch::Print() const
+{
+	printf("Offered CPS   attempts   answered   fail%%  INVITE->200 p50 (us)  p99 (us)\n");
+	for (auto& step : steps)
+	{
+		printf("%11.1f %10lu %10lu %7.2f %21lu %9lu %s\n", step.offered_cps, step.attempts, step.answered,
+				step.fail_pct, step.p50_us, step.p99_us, step.pass ? "" : "FAIL");
+	}
+
+	if (best > 0)
+		printf("Maximum sustainable rate %.1f CPS (failures <= %.2f%%, p99 INVITE->200 <= %.0fms)\n",
+				best, cfg.slo_fail_pct, cfg.slo_p99_ms);
+	else
+		printf("Not even %.1f CPS stayed within failures <= %.2f%% and p99 INVITE->200 <= %.0fms\n",
+				cfg.start_cps, cfg.slo_fail_pct, cfg.slo_p99_ms);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "CallGenerator.h"
+
+//how the search moves and what it has to stay within
+struct CpsSearchConfig
+{
+	double   start_cps;     //first rate tried
+	double   factor;        //each rate while every step passes is the last one times this
+	double   precision;     //stop bisecting once the failing rate is within this fraction of the passing one
+	double   max_cps;       //never offer more than this
+	std::chrono::seconds window; //how long each rate is held
+	double   slo_fail_pct;  //most calls that may fail at a rate that passes
+	double   slo_p99_ms;    //highest p99 INVITE to 200 OK at a rate that passes
+};
+
+//what one rate came to
+struct CpsStep
+{
+	double   offered_cps;
+	uint64_t attempts;   //handed to the stack
+	uint64_t answered;   //reached CONFIRMED
+	uint64_t failed;     //refused by the stack, or cleared with anything but a 2xx
+	double   fail_pct;
+	uint64_t p50_us;     //INVITE to 200 OK
+	uint64_t p99_us;
+	bool     pass;
+};
+
+//finds the most calls per second we can sustain. Rates go up by factor from start_cps while every step stays within
+//the SLOs, then the search bisects between the last rate that passed and the first that failed. Each rate gets a
+//fresh generator held for window; the failures and latency are what was counted during the window
+class CpsSearch {
+public:
+	typedef std::function<uint64_t()> AnsweredFn;
+
+	CpsSearch(const CpsSearchConfig& cfg, const CallGeneratorConfig& gen_cfg, CallGenerator::PlaceCallFn placeCall,
+			CallGenerator::ActiveCallsFn activeCalls, AnsweredFn answered);
+
+	//returns the highest rate that passed, 0 if not even start_cps did
+	double Run();
+
+	//the CPS against latency curve, in the order the rates were tried
+	void Print() const;
+
+private:
+	CpsStep RunStep(double cps);
+
+	const CpsSearchConfig cfg;
+	CallGeneratorConfig genCfg;
+	CallGenerator::PlaceCallFn placeCall;
+	CallGenerator::ActiveCallsFn activeCalls;
+	AnsweredFn answered;
+
+	std::vector<CpsStep> steps;
+	double best;
+};
@@ -0,0 +1,240 @@
+#include "DirectMedia.h"
+#include "PayloadCache.h"
+
+#include <cstdlib>
+#include <iostream>
+#include <mutex>
+
+#define THIS_FILE "DIRECT_MEDIA"
+
+//the most a tick can ask for - 20ms of 48kHz stereo
+#define MAX_SAMPLES 1920
+
+#define RTP_HEADER 12
+
+namespace {
+
+const pj_int16_t silence[MAX_SAMPLES] = { 0 };
+
+}
+
+struct DirectMedia::Shard
+{
+	pjmedia_clock* clock;
+
+	//held by the clock thread for the whole tick - so Detach cannot return with the port in use
+	std::mutex mutex;
+	std::vector<pjsua_call_id> calls;
+
+	pj_int16_t sink[MAX_SAMPLES]; //what the streams hand back is counted, then written over
+	uint8_t packet[RTP_HEADER + MAX_SAMPLES]; //a cached payload behind a header of its own
+
+	std::atomic<uint64_t> sent;
+	std::atomic<uint64_t> received;
+	std::atomic<uint64_t> empty;
+};
+
+DirectMedia::Shard* DirectMedia::shards = NULL;
+unsigned DirectMedia::clocks = 0;
+std::vector<DirectMedia::Slot> DirectMedia::slots;
+std::atomic<unsigned> DirectMedia::next(0);
+unsigned DirectMedia::clockRate = 0;
+unsigned DirectMedia::samplesPerFrame = 0;
+
+void DirectMedia::Start(unsigned threads, unsigned max_calls, unsigned clock_rate, unsigned samples_per_frame)
+{
+	if (clocks || !threads)
+		return;
+
+	if (samples_per_frame > MAX_SAMPLES)
+	{
+		std::cerr << "WTF - direct media frames of " << samples_per_frame << " samples are more than " << MAX_SAMPLES << std::endl;
+		exit(-1);
+	}
+
+	clockRate = clock_rate;
+	samplesPerFrame = samples_per_frame;
+	slots.assign(max_calls, Slot());
+	for (auto& slot : slots)
+	{
+		slot.port = NULL;
+		slot.shard = -1;
+		slot.tp = NULL;
+	}
+
+	pj_pool_t* pool = pjsua_pool_create("direct_media", 512, 512);
+	shards = new Shard[threads];
+
+	for (unsigned i=0; i<threads; i++)
+	{
+		Shard& shard = shards[i];
+		shard.sent = 0;
+		shard.received = 0;
+		shard.empty = 0;
+
+		pj_status_t status = pjmedia_clock_create(pool, clock_rate, 1, samples_per_frame, 0, &DirectMedia::OnTick,
+				&shard, &shard.clock);
+		if (status != PJ_SUCCESS)
+		{
+			std::cerr << "WTF - cannot create direct media clock " << i << std::endl;
+			exit(-1);
+		}
+	}
+
+	clocks = threads;
+	for (unsigned i=0; i<clocks; i++)
+		pjmedia_clock_start(shards[i].clock);
+
+	PJ_LOG(3,(THIS_FILE, "Driving call media from %u clocks of %u samples at %uHz", clocks, samples_per_frame, clock_rate));
+}
+
+void DirectMedia::Stop()
+{
+	if (!clocks)
+		return;
+
+	//stopping waits for the tick under way
+	for (unsigned i=0; i<clocks; i++)
+	{
+		pjmedia_clock_stop(shards[i].clock);
+		pjmedia_clock_destroy(shards[i].clock);
+	}
+	clocks = 0;
+}
+
+bool DirectMedia::Attach(pjsua_call_id call_id, pjmedia_stream* stream, pjmedia_port* port)
+{
+	if (!clocks || call_id < 0 || (unsigned)call_id >= slots.size())
+		return false;
+
+	//the stream gets exactly what the clock gives it each tick - anything else would starve or flood it
+	if (PJMEDIA_PIA_SRATE(&port->info) != clockRate || PJMEDIA_PIA_SPF(&port->info) != samplesPerFrame ||
+			PJMEDIA_PIA_CCNT(&port->info) != 1)
+		return false;
+
+	Slot& slot = slots[call_id];
+	pjmedia_stream_info info;
+	pjmedia_transport* tp = NULL;
+
+	//G.711 can come from the cache - under the stream's SSRC and payload type, so the far end cannot tell
+	if (PayloadCache::Enabled() && pjmedia_stream_get_info(stream, &info) == PJ_SUCCESS &&
+			PayloadCache::Frame(info.tx_pt, 0) && PayloadCache::FrameBytes() == samplesPerFrame)
+		tp = pjmedia_stream_get_transport(stream);
+
+	Shard& shard = shards[next.fetch_add(1, std::memory_order_relaxed) % clocks];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	slot.port = port;
+	slot.shard = &shard - shards;
+	slot.timestamp.u64 = 0;
+	slot.tp = tp;
+	if (tp)
+	{
+		pjmedia_rtp_session_init(&slot.rtp, info.tx_pt, info.ssrc);
+		slot.pt = info.tx_pt;
+		slot.frame = call_id; //so the calls are not all in step through a file
+		slot.marker = 1;
+	}
+	shard.calls.push_back(call_id);
+	return true;
+}
+
+void DirectMedia::Detach(pjsua_call_id call_id)
+{
+	if (!clocks || call_id < 0 || (unsigned)call_id >= slots.size())
+		return;
+
+	Slot& slot = slots[call_id];
+	if (slot.shard < 0)
+		return;
+
+	Shard& shard = shards[slot.shard];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	for (auto it = shard.calls.begin(); it != shard.calls.end(); ++it)
+	{
+		if (*it == call_id)
+		{
+			*it = shard.calls.back();
+			shard.calls.pop_back();
+			break;
+		}
+	}
+
+	slot.port = NULL;
+	slot.shard = -1;
+	slot.tp = NULL;
+}
+
+bool DirectMedia::Attached(pjsua_call_id call_id)
+{
+	return clocks && call_id >= 0 && (unsigned)call_id < slots.size() && slots[call_id].shard >= 0;
+}
+
+void DirectMedia::Take(uint64_t& sent, uint64_t& received, uint64_t& empty)
+{
+	sent = received = empty = 0;
+
+	for (unsigned i=0; i<clocks; i++)
+	{
+		sent += shards[i].sent.load(std::memory_order_relaxed);
+		received += shards[i].received.load(std::memory_order_relaxed);
+		empty += shards[i].empty.load(std::memory_order_relaxed);
+	}
+}
+
+void DirectMedia::OnTick(const pj_timestamp* ts, void* user_data)
+{
+	Shard* shard = (Shard*)user_data;
+	uint64_t sent = 0, received = 0, empty = 0;
+
+	std::lock_guard<std::mutex> lock(shard->mutex);
+
+	for (auto call_id : shard->calls)
+	{
+		Slot& slot = slots[call_id];
+		pjmedia_frame frame;
+
+		//source - a cached frame behind a fresh header, or silence for the stream to encode and send
+		if (slot.tp)
+		{
+			const void* header;
+			int header_len;
+			unsigned payload_len = PayloadCache::FrameBytes();
+
+			pjmedia_rtp_encode_rtp(&slot.rtp, slot.pt, slot.marker, payload_len, samplesPerFrame, &header, &header_len);
+			pj_memcpy(shard->packet, header, header_len);
+			pj_memcpy(shard->packet + header_len, PayloadCache::Frame(slot.pt, slot.frame++), payload_len);
+			slot.marker = 0;
+
+			if (pjmedia_transport_send_rtp(slot.tp, shard->packet, header_len + payload_len) == PJ_SUCCESS)
+				sent++;
+		}
+		else
+		{
+			pj_bzero(&frame, sizeof(frame));
+			frame.type = PJMEDIA_FRAME_TYPE_AUDIO;
+			frame.buf = (void*)silence;
+			frame.size = samplesPerFrame * sizeof(pj_int16_t);
+			frame.timestamp = slot.timestamp;
+			if (pjmedia_port_put_frame(slot.port, &frame) == PJ_SUCCESS)
+				sent++;
+		}
+		slot.timestamp.u64 += samplesPerFrame;
+
+		//sink - take what the jitter buffer has for this tick, so it drains as it would into the bridge
+		pj_bzero(&frame, sizeof(frame));
+		frame.buf = shard->sink;
+		frame.size = samplesPerFrame * sizeof(pj_int16_t);
+		if (pjmedia_port_get_frame(slot.port, &frame) == PJ_SUCCESS)
+		{
+			received++;
+			if (frame.type != PJMEDIA_FRAME_TYPE_AUDIO)
+				empty++;
+		}
+	}
+
+	shard->sent.fetch_add(sent, std::memory_order_relaxed);
+	shard->received.fetch_add(received, std::memory_order_relaxed);
+	shard->empty.fetch_add(empty, std::memory_order_relaxed);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+//feeds each call's stream straight from a frame source and drains it into a counting sink, leaving the conference
+//bridge out of it. With the bridge one clock thread mixes and encodes for every call each tick; here the calls are
+//dealt across a number of clocks, each with its own thread, so the encoding is spread over them.
+//
+//The source is silence put through the stream's encoder - or, with the PayloadCache enabled and a G.711 stream,
+//frames from the cache sent on the stream's transport behind an RTP header of our own, when the encoder is never
+//used. The sink counts what the stream hands back
+class DirectMedia {
+public:
+	//call after pjsua_init() - a clock of clock_rate / samples_per_frame for each thread, max_calls as configured
+	//there
+	static void Start(unsigned threads, unsigned max_calls, unsigned clock_rate, unsigned samples_per_frame);
+	static void Stop();
+	static bool Running() { return clocks != 0; }
+
+	//from on_stream_created - false if the stream cannot be driven at our clock (another rate or ptime, or the call
+	//is out of range), when it is left for the conference bridge - which is still clocked by the null sound device
+	static bool Attach(pjsua_call_id call_id, pjmedia_stream* stream, pjmedia_port* port);
+
+	//from on_stream_destroyed - the port is not touched again once this returns
+	static void Detach(pjsua_call_id call_id);
+
+	static bool Attached(pjsua_call_id call_id);
+
+	//frames put to the streams, and frames got back from them - with those that had no audio in them
+	static void Take(uint64_t& sent, uint64_t& received, uint64_t& empty);
+
+private:
+	struct Shard;
+
+	struct Slot
+	{
+		pjmedia_port* port;   //NULL while the call is not ours
+		int           shard;
+		pj_timestamp  timestamp;
+
+		//sending from the PayloadCache - the stream's own RTP session is left alone, as it never sends
+		pjmedia_transport*  tp;   //NULL when the stream encodes
+		pjmedia_rtp_session rtp;
+		unsigned            pt;
+		uint32_t            frame;
+		int                 marker;
+	};
+
+	static void OnTick(const pj_timestamp* ts, void* user_data);
+
+	static Shard* shards;
+	static unsigned clocks;
+	static std::vector<Slot> slots;
+	static std::atomic<unsigned> next;
+	static unsigned clockRate;
+	static unsigned samplesPerFrame;
+};
@@ -0,0 +1,80 @@
+#include "DisconnectStats.h"
+
+//zero initialised as statics, so the atomics need no constructor run
+DisconnectStats::Shard DisconnectStats::shards[DisconnectStats::SHARDS];
+std::atomic<unsigned> DisconnectStats::nextShard(0);
+
+uint64_t DisconnectStats::Snapshot::ByCode(unsigned code) const
+{
+	uint64_t sum = 0;
+
+	for (unsigned type=0; type<TYPES; type++)
+		for (unsigned dir=0; dir<DIRECTIONS; dir++)
+			sum += counts[type][dir][code];
+	return sum;
+}
+
+uint64_t DisconnectStats::Snapshot::ByType(unsigned type, unsigned direction) const
+{
+	uint64_t sum = 0;
+
+	for (unsigned code=0; code<CODES; code++)
+		sum += counts[type][direction][code];
+	return sum;
+}
+
+//threads are handed shards round robin the first time they record - with no more worker threads than shards each
+//writes to a shard no other thread touches
+DisconnectStats::Shard* DisconnectStats::ThisThreadShard()
+{
+	static __thread Shard* shard = NULL;
+
+	if (!shard)
+		shard = &shards[nextShard.fetch_add(1, std::memory_order_relaxed) % SHARDS];
+	return shard;
+}
+
+void DisconnectStats::Record(eCallType type, bool bidirectional, int status)
+{
+	Shard* shard = ThisThreadShard();
+	unsigned code = (status < 0 || (unsigned)status >= CODES) ? 0 : status;
+
+	shard->counts[type._to_integral()][bidirectional ? 1 : 0][code].fetch_add(1, std::memory_order_relaxed);
+	shard->total.fetch_add(1, std::memory_order_release);
+}
+
+void DisconnectStats::Take(Snapshot& snap)
+{
+	snap.total = 0;
+	for (unsigned type=0; type<TYPES; type++)
+		for (unsigned dir=0; dir<DIRECTIONS; dir++)
+			for (unsigned code=0; code<CODES; code++)
+				snap.counts[type][dir][code] = 0;
+
+	for (unsigned s=0; s<SHARDS; s++)
+	{
+		Shard& shard = shards[s];
+		uint64_t local[TYPES][DIRECTIONS][CODES];
+		uint64_t before, sum;
+		unsigned tries = 0;
+
+		//the code counter goes up before the total, so once we have seen a total every count that makes it up is
+		//visible. If the counts add up to more, a call was cleared while we were reading - go round again. Under
+		//sustained load settle for the last read after a few goes rather than spin
+		do
+		{
+			before = shard.total.load(std::memory_order_acquire);
+			sum = 0;
+			for (unsigned type=0; type<TYPES; type++)
+				for (unsigned dir=0; dir<DIRECTIONS; dir++)
+					for (unsigned code=0; code<CODES; code++)
+						sum += local[type][dir][code] = shard.counts[type][dir][code].load(std::memory_order_relaxed);
+		} while (sum != before && ++tries < 8);
+
+		snap.total += sum;
+		for (unsigned type=0; type<TYPES; type++)
+			for (unsigned dir=0; dir<DIRECTIONS; dir++)
+				for (unsigned code=0; code<CODES; code++)
+					snap.counts[type][dir][code] += local[type][dir][code];
+	}
+}
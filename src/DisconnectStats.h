@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "CallContext.h"
+
+//counts of cleared calls by final status code, call type and media direction. Any pjsip worker thread can record
+//without taking a lock - each thread picks a shard of its own and bumps relaxed atomics in it. Reading sums the
+//shards, checking each against its running total so the snapshot is not torn by a call cleared part way through
+class DisconnectStats {
+public:
+	static const unsigned CODES = 1000;  //status codes 0-999 - anything out of range is counted against 0
+	static const unsigned TYPES = eCallType::_size_constant;
+	static const unsigned DIRECTIONS = 2; //uni or bi directional
+	static const unsigned SHARDS = 16;
+
+	struct Snapshot
+	{
+		uint64_t total;
+		uint64_t counts[TYPES][DIRECTIONS][CODES];
+
+		//all calls cleared with code, whatever their type and direction
+		uint64_t ByCode(unsigned code) const;
+		//all calls of this type and direction, whatever their code
+		uint64_t ByType(unsigned type, unsigned direction) const;
+	};
+
+	static void Record(eCallType type, bool bidirectional, int status);
+
+	//fill in snap - reads are relaxed apart from the shard totals, so this never holds up Record
+	static void Take(Snapshot& snap);
+
+private:
+	struct alignas(64) Shard
+	{
+		std::atomic<uint64_t> total; //bumped after the code counter, so a reader knows how many to expect
+		std::atomic<uint64_t> counts[TYPES][DIRECTIONS][CODES];
+	};
+
+	static Shard* ThisThreadShard();
+
+	static Shard shards[SHARDS];
+	static std::atomic<unsigned> nextShard;
+};
@@ -1,8 +1,10 @@
 #include <pjsua-lib/pjsua.h>
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <atomic>
+#include <memory>
 #include <pj/file_access.h>
 
 #include <boost/program_options.hpp>
@@ -13,7 +15,29 @@
 #include <pjsua-lib/pjsua.h>
 #include <pjsua-lib/pjsua_internal.h>
 #include <sched.h>
+#include <errno.h>
+#include <sys/socket.h>
 #include "Enum.h"
+#include "CallContext.h"
+#include "CallGenerator.h"
+#include "CallRegistry.h"
+#include "ConnectionPool.h"
+#include "CpsSearch.h"
+#include "DirectMedia.h"
+#include "DisconnectStats.h"
+#include "IsupBodyCache.h"
+#include "LatencyHistogram.h"
+#include "LoopbackBench.h"
+#include "MetricsExporter.h"
+#include "NullMediaTransport.h"
+#include "PacketCapture.h"
+#include "PayloadCache.h"
+#include "RtpPacer.h"
+#include "RtpShards.h"
+#include "RtpStats.h"
+#include "SdpTemplates.h"
+#include "ShardSupervisor.h"
+#include "SipTransports.h"
 
 
 
@@ -27,6 +51,9 @@
 namespace po = boost::program_options;
 namespace al = boost::algorithm;
 
+static bool signalling_only = false; //calls get a NullMediaTransport and their media inactive - no RTP at all
+static bool direct_media = false; //streams are driven by DirectMedia rather than through the conference bridge
+
 
 /* Transport functions prototypes */
 static pj_status_t transport_get_info (pjmedia_transport *tp,
@@ -68,9 +95,6 @@ static pj_status_t transport_simulate_lost(pjmedia_transport *tp,
 static pj_status_t transport_destroy  (pjmedia_transport *tp);
 
 
-static __thread uint64_t counter;
-
-
 /* The transport operations */
 static struct pjmedia_transport_op tp_adapter_op =
 {
@@ -112,6 +136,15 @@ struct tp_adapter
 
 	/* Add your own member here.. */
 	pjmedia_transport	*slave_tp;
+	RtpCounters		*stats;  //slot of the call we belong to - set once the call id is known
+	pj_bool_t		 capture; //this call was picked for the pcap files
+	uint32_t		 capture_packets;
+	PcapFlow		 capture_flow;
+	pj_bool_t		 paced;   //RTP goes out through the RtpPacer rather than the slave transport
+	RtpPacerTarget		 pacer;
+	int			 rx_shard; //RtpShards shard RTP is received on, -1 if it comes through the slave transport
+	pj_bool_t		 rx_bound;
+	pj_sockaddr		 rx_remote;
 };
 
 
@@ -143,6 +176,8 @@ PJ_DEF(pj_status_t) pjmedia_tp_adapter_create( pjmedia_endpt *endpt,
 	/* Save the transport as the slave transport */
 	adapter->slave_tp = transport;
 	adapter->del_base = del_base;
+	adapter->stats = RtpStats::Unbound(); //until on_create_media_transport tells us the call
+	adapter->rx_shard = -1;
 
 	/* Done */
 	*p_tp = &adapter->base;
@@ -162,7 +197,14 @@ static pj_status_t transport_get_info(pjmedia_transport *tp,
 	/* Since we don't have our own connection here, we just pass
 	 * this function to the slave transport.
 	 */
-	return pjmedia_transport_get_info(adapter->slave_tp, info);
+	pj_status_t status = pjmedia_transport_get_info(adapter->slave_tp, info);
+
+	//RTP is to come to our shard - RTCP still goes to the slave, and as that is no longer the RTP port + 1 the SDP
+	//gets an a=rtcp saying so
+	if (status == PJ_SUCCESS && adapter->rx_shard >= 0 && info->sock_info.rtp_addr_name.addr.sa_family == pj_AF_INET())
+		info->sock_info.rtp_addr_name.ipv4.sin_port = pj_htons(RtpShards::Port(adapter->rx_shard));
+
+	return status;
 }
 
 
@@ -175,6 +217,10 @@ static void transport_rtp_cb(void *user_data, void *pkt, pj_ssize_t size)
 
 	//pj_assert(adapter->stream_rtp_cb != NULL);
 
+	adapter->stats->CountRx(size);
+	if (adapter->capture)
+		PacketCapture::Capture(adapter->capture_flow, adapter->capture_packets, false, false, pkt, size);
+
 	/* Call stream's callback */
 	adapter->stream_rtp_cb(adapter->stream_user_data, pkt, size);
 }
@@ -187,10 +233,35 @@ static void transport_rtp_cb2(pjmedia_tp_cb_param *param)
 	new_param=*param;
 	new_param.user_data=adapter->stream_user_data;
 
+	adapter->stats->CountRx(param->size);
+	if (adapter->capture)
+		PacketCapture::Capture(adapter->capture_flow, adapter->capture_packets, false, false, param->pkt, param->size);
 
 	/* Call stream's callback */
 	adapter->stream_rtp_cb2(&new_param);
-	counter++;
+}
+
+//what an RtpShards shard received from the far end of this adapter - in on the shard thread
+static void transport_shard_cb(void *owner, void *pkt, pj_ssize_t size, const pj_sockaddr *src)
+{
+	struct tp_adapter *adapter = (struct tp_adapter*)owner;
+
+	if (adapter->stream_rtp_cb2)
+	{
+		pjmedia_tp_cb_param param;
+
+		pj_bzero(&param, sizeof(param));
+		param.user_data = adapter;
+		param.pkt = pkt;
+		param.size = size;
+		param.src_addr = (pj_sockaddr*)src;
+		param.rem_switch = PJ_FALSE;
+		transport_rtp_cb2(&param);
+	}
+	else if (adapter->stream_rtp_cb)
+	{
+		transport_rtp_cb(adapter, pkt, size);
+	}
 }
 
 
@@ -203,12 +274,60 @@ static void transport_rtcp_cb(void *user_data, void *pkt, pj_ssize_t size)
 
 	pj_assert(adapter->stream_rtcp_cb != NULL);
 
+	adapter->stats->CountRxRtcp(size);
+	if (adapter->capture)
+		PacketCapture::Capture(adapter->capture_flow, adapter->capture_packets, false, true, pkt, size);
+
 	/* Call stream's callback */
 	adapter->stream_rtcp_cb(adapter->stream_user_data, pkt, size);
 }
 
 
 
+static void fill_capture_flow(struct tp_adapter *adapter, const pjmedia_transport_attach_param *att_param)
+{
+	pjmedia_transport_info info;
+	PcapFlow& flow = adapter->capture_flow;
+
+	pj_bzero(&flow, sizeof(flow));
+	pjmedia_transport_info_init(&info);
+
+	if (pjmedia_transport_get_info(adapter->slave_tp, &info) == PJ_SUCCESS &&
+			info.sock_info.rtp_addr_name.addr.sa_family == pj_AF_INET())
+	{
+		flow.local_ip = info.sock_info.rtp_addr_name.ipv4.sin_addr.s_addr;
+		flow.local_rtp_port = adapter->rx_shard >= 0 ? pj_htons(RtpShards::Port(adapter->rx_shard)) :
+				info.sock_info.rtp_addr_name.ipv4.sin_port;
+		flow.local_rtcp_port = info.sock_info.rtcp_addr_name.ipv4.sin_port;
+	}
+
+	if (att_param->rem_addr.addr.sa_family == pj_AF_INET())
+	{
+		flow.remote_ip = att_param->rem_addr.ipv4.sin_addr.s_addr;
+		flow.remote_rtp_port = att_param->rem_addr.ipv4.sin_port;
+		flow.remote_rtcp_port = att_param->rem_rtcp.ipv4.sin_port;
+	}
+}
+
+//the pacer writes straight to the slave transport's socket - so only for plain IPv4 UDP, where there is one. A
+//sharded stream sends from its shard's socket, which it shares with the other streams of the shard
+static void fill_pacer_target(struct tp_adapter *adapter, const pjmedia_transport_attach_param *att_param)
+{
+	pjmedia_transport_info info;
+
+	pjmedia_transport_info_init(&info);
+
+	if (pjmedia_transport_get_info(adapter->slave_tp, &info) != PJ_SUCCESS || info.sock_info.rtp_sock == PJ_INVALID_SOCKET ||
+			att_param->rem_addr.addr.sa_family != pj_AF_INET())
+		return;
+
+	adapter->pacer.fd = adapter->rx_shard >= 0 ? RtpShards::Socket(adapter->rx_shard) : info.sock_info.rtp_sock;
+	pj_memcpy(&adapter->pacer.addr, &att_param->rem_addr, sizeof(adapter->pacer.addr));
+	adapter->pacer.addr_len = att_param->addr_len;
+	adapter->pacer.stats = adapter->stats;
+	adapter->paced = PJ_TRUE;
+}
+
 /*
  * attach2() is called by stream to register callbacks that we should
  * call on receipt of RTP and RTCP packets.
@@ -235,6 +354,13 @@ static pj_status_t transport_attach2(pjmedia_transport *tp,
 	att_param->rtcp_cb = &transport_rtcp_cb;
 	att_param->user_data = adapter;
 
+	//the addresses the pcap records are made up from - the stream is only attached once they are both known
+	if (adapter->capture)
+		fill_capture_flow(adapter, att_param);
+
+	if (RtpPacer::Running())
+		fill_pacer_target(adapter, att_param);
+
 	status = pjmedia_transport_attach2(adapter->slave_tp, att_param);
 	if (status != PJ_SUCCESS) {
 		adapter->stream_user_data = NULL;
@@ -245,6 +371,13 @@ static pj_status_t transport_attach2(pjmedia_transport *tp,
 		return status;
 	}
 
+	//from here what the shard receives from the far end is ours
+	if (adapter->rx_shard >= 0)
+	{
+		pj_memcpy(&adapter->rx_remote, &att_param->rem_addr, sizeof(adapter->rx_remote));
+		adapter->rx_bound = RtpShards::Bind(adapter->rx_shard, adapter->rx_remote, adapter);
+	}
+
 	return PJ_SUCCESS;
 }
 
@@ -258,6 +391,15 @@ static void transport_detach(pjmedia_transport *tp, void *strm)
 
 	PJ_UNUSED_ARG(strm);
 
+	//anything already queued still goes - destroy waits for it
+	adapter->paced = PJ_FALSE;
+
+	//waits for the shard to finish with us
+	if (adapter->rx_bound) {
+		RtpShards::Unbind(adapter->rx_shard, adapter->rx_remote, adapter);
+		adapter->rx_bound = PJ_FALSE;
+	}
+
 	if (adapter->stream_user_data != NULL) {
 		pjmedia_transport_detach(adapter->slave_tp, adapter);
 		adapter->stream_user_data = NULL;
@@ -281,8 +423,33 @@ static pj_status_t transport_send_rtp( pjmedia_transport *tp,
 
 	/* You may do some processing to the RTP packet here if you want. */
 
+	//the pacer counts it once it has really gone
+	if (adapter->paced && RtpPacer::Queue(&adapter->pacer, pkt, size))
+	{
+		if (adapter->capture)
+			PacketCapture::Capture(adapter->capture_flow, adapter->capture_packets, true, false, pkt, size);
+		return PJ_SUCCESS;
+	}
+
+	//out of the shard socket, so it comes from the port the far end is sending to
+	if (adapter->rx_bound)
+	{
+		pj_status_t status = PJ_SUCCESS;
+		if (sendto(RtpShards::Socket(adapter->rx_shard), pkt, size, 0, (const struct sockaddr*)&adapter->rx_remote,
+				sizeof(adapter->rx_remote.ipv4)) < 0)
+			status = PJ_STATUS_FROM_OS(errno);
+		adapter->stats->CountTx(size, status);
+		if (adapter->capture && status == PJ_SUCCESS)
+			PacketCapture::Capture(adapter->capture_flow, adapter->capture_packets, true, false, pkt, size);
+		return status;
+	}
+
 	/* Send the packet using the slave transport */
-	return pjmedia_transport_send_rtp(adapter->slave_tp, pkt, size);
+	pj_status_t status = pjmedia_transport_send_rtp(adapter->slave_tp, pkt, size);
+	adapter->stats->CountTx(size, status);
+	if (adapter->capture && status == PJ_SUCCESS)
+		PacketCapture::Capture(adapter->capture_flow, adapter->capture_packets, true, false, pkt, size);
+	return status;
 }
 
 
@@ -299,7 +466,11 @@ static pj_status_t transport_send_rtcp(pjmedia_transport *tp,
 	/* You may do some processing to the RTCP packet here if you want. */
 
 	/* Send the packet using the slave transport */
-	return pjmedia_transport_send_rtcp(adapter->slave_tp, pkt, size);
+	pj_status_t status = pjmedia_transport_send_rtcp(adapter->slave_tp, pkt, size);
+	adapter->stats->CountTxRtcp(size, status);
+	if (adapter->capture && status == PJ_SUCCESS)
+		PacketCapture::Capture(adapter->capture_flow, adapter->capture_packets, true, true, pkt, size);
+	return status;
 }
 
 
@@ -314,8 +485,12 @@ static pj_status_t transport_send_rtcp2(pjmedia_transport *tp,
 		pj_size_t size)
 {
 	struct tp_adapter *adapter = (struct tp_adapter*)tp;
-	return pjmedia_transport_send_rtcp2(adapter->slave_tp, addr, addr_len,
+	pj_status_t status = pjmedia_transport_send_rtcp2(adapter->slave_tp, addr, addr_len,
 			pkt, size);
+	adapter->stats->CountTxRtcp(size, status);
+	if (adapter->capture && status == PJ_SUCCESS)
+		PacketCapture::Capture(adapter->capture_flow, adapter->capture_packets, true, true, pkt, size);
+	return status;
 }
 
 /*
@@ -420,6 +595,10 @@ static pj_status_t transport_destroy  (pjmedia_transport *tp)
 {
 	struct tp_adapter *adapter = (struct tp_adapter*)tp;
 
+	//the pacer may still have packets for the socket we are about to close - and it points back into this adapter
+	adapter->paced = PJ_FALSE;
+	RtpPacer::Forget(&adapter->pacer);
+
 	/* Close the slave transport */
 	if (adapter->del_base) {
 		pjmedia_transport_close(adapter->slave_tp);
@@ -431,296 +610,6 @@ static pj_status_t transport_destroy  (pjmedia_transport *tp)
 	return PJ_SUCCESS;
 }
 
-ENUM(eCallType, uint16_t, UNINITIALISED, SIMULATED_AXE_CALL_OFFER, SIMULATED_S10_CALL_OFFER, RECEIVED_CALL );
-ENUM(eSimulatorDirectionType, uint16_t, SIMULATED_UNI_DIRECTIONAL, SIMULATE_BI_DIRECTIONAL);
-ENUM(eAgentDirectionType, uint16_t,  ANSWER_UNI_DIRECTIONAL, ANSWER_BI_DIRECTIONAL );
-
-//grab bag for anything required on a per call basis - sorta C/C++ halfway house of yuk...
-class LocalCallUserData {
-public:
-	pj_pool_t* pool;
-	eCallType  callType;
-	eSimulatorDirectionType simDir;
-	eAgentDirectionType agentDir;
-	boost::optional<pjsua_call_id> call_id;
-	std::vector<char> sdp_buf;
-	bool confirmed;
-
-
-	std::shared_ptr<std::function<void(void)>> clearCallTimerCB;
-
-
-	LocalCallUserData():callType(eCallType::UNINITIALISED),
-			simDir(eSimulatorDirectionType::SIMULATED_UNI_DIRECTIONAL),
-			agentDir(eAgentDirectionType::ANSWER_UNI_DIRECTIONAL),call_id(boost::none),sdp_buf(2000,0),confirmed(false)
-	{
-		pool = pjmedia_endpt_create_pool(pjsua_get_pjmedia_endpt(), "USER_CALL_%p", 512, 512);
-	}
-
-	~LocalCallUserData()
-	{
-		pj_pool_release(pool); //this frees up the memory under the object!
-	}
-
-	static LocalCallUserData* LookupByCall(pjsua_call_id call_id)
-	{
-		auto call = (LocalCallUserData*)pjsua_call_get_user_data (call_id);
-		return call;
-	}
-
-	void BindToCall(pjsua_call_id _call_id)
-	{
-		call_id=_call_id;
-		pjsua_call_set_user_data (_call_id,this);
-	}
-
-	void SaveSDP()
-	{
-		if(call_id==boost::none)
-		{
-			std::cerr << "WTF - trying to save sdp in unbound call context";
-			exit(-1);
-		}
-
-		PJSUA_LOCK();
-
-		auto call = &pjsua_var.calls[call_id.get()];
-		pjmedia_sdp_neg* sdp_neg = call->inv->neg;
-
-		PJSUA_UNLOCK();
-
-		pjmedia_sdp_session* sdp;
-
-		pjmedia_sdp_neg_get_active_local(sdp_neg,(const pjmedia_sdp_session** )&sdp);
-
-		int sz;
-		while((sz = pjmedia_sdp_print (sdp, sdp_buf.data(), sdp_buf.size()))==-1)
-		{
-			sdp_buf.resize(sdp_buf.size() * 2);
-		}
-		sdp_buf.resize(sz+1);
-		confirmed=true;
-	}
-
-	static void timer_heap_callback(void *user_data)
-	{
-		LocalCallUserData* callUserData = (LocalCallUserData*)user_data;
-		(*(callUserData->clearCallTimerCB))();
-	}
-
-	void SetHangupTimer(uint32_t sec_timeout)
-	{
-		if(call_id==boost::none)
-		{
-			std::cerr << "WTF - trying to set timer on call object that is not initialised";
-			exit(-1);
-		}
-		pjsua_call_id c = call_id.get(); //capture c by value
-		std::function<void(void)>* lambda = new std::function<void(void)>([c](void)
-				{
-			pjsua_call_hangup(c,200,0,0);
-				}
-		);
-		clearCallTimerCB=std::shared_ptr<std::function<void(void)>>(lambda);
-		pjsua_schedule_timer2(timer_heap_callback,this,sec_timeout*1000);
-	}
-
-
-};
-
-
-//replace this with generating a legitimate ISUP IAM in the content_string - treat it as a bucket of bytes - NOT NULL TERMINATED STRING
-void add_SIP_I_AXE_IAM_Mime(pj_pool_t* pool, pjsua_msg_data *msg_data)
-{
-	pjsip_multipart_part *alt_part;
-	const char* content_type_string = "application";
-	const char* content_subtype_string = "ISUP; version=itu-t92+ \nContent-Disposition: signal; handling=required";
-
-	/*this is an IAM string extracted from PCAP trace
-	ISDN User Part
-	    Message Type: Initial address (1)
-	    Nature of Connection Indicators : 0x0
-	        Mandatory Parameter: Nature of connection indicators (6)
-	        .... ..00 = Satellite Indicator: No Satellite circuit in connection (0x0)
-	        .... 00.. = Continuity Check Indicator: Continuity check not required (0x0)
-	        ...0 .... = Echo Control Device Indicator: Echo control device not included
-	    Forward Call Indicators : 0x2001
-	        Mandatory Parameter: Forward call indicators (7)
-	        .... ...0 .... .... = National/international call indicator: Call to be treated as national call
-	        .... .00. .... .... = End-to-end method indicator: No End-to-end method available (only link-by-link method available) (0x0)
-	        .... 0... .... .... = Interworking indicator: no interworking encountered (No.7 signalling all the way)
-	        ...0 .... .... .... = End-to-end information indicator: no end-to-end information available
-	        ..1. .... .... .... = ISDN user part indicator: ISDN user part used all the way
-	        00.. .... .... .... = ISDN user part preference indicator: ISDN user part preferred all the way (0x0)
-	        .... .... .... ...1 = ISDN access indicator: originating access ISDN
-	        .... .... .... .00. = SCCP method indicator: No indication (0x0)
-	        .... .... ...0 .... = Ported number translation indicator: number not translated
-	        .... .... ..0. .... = Query on Release attempt indicator: no QoR routing attempt in progress
-	    Calling Party's category : 0xf7 (reserved/spare)
-	        Mandatory Parameter: Calling party's category (9)
-	        Calling Party's category: Unknown (0xf7)
-	    Transmission medium requirement : 0 (speech)
-	        Mandatory Parameter: Transmission medium requirement (2)
-	        Transmission medium requirement: speech (0)
-	    Called Party NumberCalled Party Number: 0396504232F
-	        Mandatory Parameter: Called party number (4)
-	        Pointer to Parameter: 2
-	        Parameter Length: 8
-	        1... .... = Odd/even indicator: odd number of address signals
-	        .000 0010 = Nature of address indicator: unknown (national use) (2)
-	        1... .... = INN indicator: routing to internal network number not allowed
-	        .001 .... = Numbering plan indicator: ISDN (Telephony) numbering plan (1)
-	        Called Party Number: 0396504232F
-	            .... 0000 = Address signal digit: 0 (0)
-	            0011 .... = Address signal digit: 3 (3)
-	            .... 1001 = Address signal digit: 9 (9)
-	            0110 .... = Address signal digit: 6 (6)
-	            .... 0101 = Address signal digit: 5 (5)
-	            0000 .... = Address signal digit: 0 (0)
-	            .... 0100 = Address signal digit: 4 (4)
-	            0010 .... = Address signal digit: 2 (2)
-	            .... 0011 = Address signal digit: 3 (3)
-	            0010 .... = Address signal digit: 2 (2)
-	            .... 1111 = Address signal digit: Stop sending (15)
-	            E.164 Called party number digits: 0396504232F
-	    Pointer to start of optional part: 10
-	    Parameter: (t=10, l=7) Calling party number: Calling party numberCalling Party Number: 418702172
-	        Optional Parameter: Calling party number (10)
-	        Parameter Length: 7
-	        1... .... = Odd/even indicator: odd number of address signals
-	        .000 0011 = Nature of address indicator: national (significant) number (3)
-	        0... .... = NI indicator: complete
-	        .001 .... = Numbering plan indicator: ISDN (Telephony) numbering plan (1)
-	        .... 00.. = Address presentation restricted indicator: presentation allowed (0)
-	        .... ..11 = Screening indicator: network provided (3)
-	        Calling Party Number: 418702172
-	            .... 0100 = Address signal digit: 4 (4)
-	            0001 .... = Address signal digit: 1 (1)
-	            .... 1000 = Address signal digit: 8 (8)
-	            0111 .... = Address signal digit: 7 (7)
-	            .... 0000 = Address signal digit: 0 (0)
-	            0010 .... = Address signal digit: 2 (2)
-	            .... 0001 = Address signal digit: 1 (1)
-	            0111 .... = Address signal digit: 7 (7)
-	            .... 0010 = Address signal digit: 2 (2)
-	            E.164 Calling party number digits: 418702172
-	    Parameter: (t=3, l=37) Access transport: Access transport
-	        Optional Parameter: Access transport (3)
-	        Parameter Length: 37
-	        Access transport parameter field (-> Q.931): 710ca01100f1400000f1400000f06d15a020003101001081...
-	        Called party subaddress
-	            Information element: Called party subaddress
-	            Length: 12
-	            .010 .... = Type of subaddress: Unknown (0x2)
-	            .... 0... = Odd/even indicator: Even number of address signals (0x0)
-	            Subaddress: 1100f1400000f1400000f0
-	        Calling party subaddress
-	            Information element: Calling party subaddress
-	            Length: 21
-	            .010 .... = Type of subaddress: Unknown (0x2)
-	            .... 0... = Odd/even indicator: Even number of address signals (0x0)
-	            Subaddress: 200031010010818080010001f2f1ff0080ffff11
-	    End of optional parameters (0)
-	 */
-	const uint8_t content_string[] = {
-			0x01,0x00,0x20,0x01,0xf7,0x00,0x02,0x0a,
-			0x08,0x82,0x90,0x30,0x69,0x05,0x24,0x23,
-			0x0f,0x0a,0x07,0x83,0x13,0x14,0x78,0x20,
-			0x71,0x02,0x03,0x25,0x71,0x0c,0xa0,0x11,
-			0x00,0xf1,0x40,0x00,0x00,0xf1,0x40,0x00,
-			0x00,0xf0,0x6d,0x15,0xa0,0x20,0x00,0x31,
-			0x01,0x00,0x10,0x81,0x80,0x80,0x01,0x00,
-			0x01,0xf2,0xf1,0xff,0x00,0x80,0xff,0xff,
-			0x11,0x00
-	};
-
-
-	const pj_str_t content_type=pj_str((char*)content_type_string);
-	const pj_str_t content_subtype=pj_str((char*)content_subtype_string);
-	const pj_str_t content={(char*)content_string,sizeof(content_string)}; //note NOT STRLEN!!!
-
-	alt_part = pjsip_multipart_create_part(pool);
-	alt_part->body = pjsip_msg_body_create(pool, &content_type,
-			&content_subtype, &content);
-
-	pjsua_msg_data_init(msg_data);
-
-	msg_data->multipart_ctype.type = pj_str((char*)"multipart");
-	msg_data->multipart_ctype.subtype = pj_str((char*)"mixed");
-	pj_list_push_back(&msg_data->multipart_parts, alt_part);
-}
-
-void add_SIP_I_S12_IAM_Mime(pj_pool_t* pool, pjsua_msg_data *msg_data)
-{
-	pjsip_multipart_part *alt_part;
-	const char* content_type_string = "application";
-	const char* content_subtype_string = "ISUP; version=itu-t92+ \nContent-Disposition: signal; handling=required";
-	const char content_string[] = "THIS WAS AN S12 IAM A bunch of zeros \0\0\0\0 And after the zeros - ";
-
-	const pj_str_t content_type=pj_str((char*)content_type_string);
-	const pj_str_t content_subtype=pj_str((char*)content_subtype_string);
-	const pj_str_t content={(char*)content_string,sizeof(content_string)}; //note NOT STRLEN!!!
-
-	alt_part = pjsip_multipart_create_part(pool);
-	alt_part->body = pjsip_msg_body_create(pool, &content_type,
-			&content_subtype, &content);
-
-	pjsua_msg_data_init(msg_data);
-
-	msg_data->multipart_ctype.type = pj_str((char*)"multipart");
-	msg_data->multipart_ctype.subtype = pj_str((char*)"mixed");
-	pj_list_push_back(&msg_data->multipart_parts, alt_part);
-}
-
-
-//the CON ISUP message to append on the reply - its always the same
-void add_SIP_I_CON_Mime(pj_pool_t* pool, pjsua_msg_data *msg_data)
-{
-	pjsip_multipart_part *alt_part;
-	const char* content_type_string = "application";
-	const char* content_subtype_string = "ISUP; version=itu-t92+ \nContent-Disposition: signal; handling=required";
-	//CON + BACKWARD CALL INDICATOR BYTES
-	const char content_string[] = { 0x07, 0x06, 0x16 };
-
-	const pj_str_t content_type=pj_str((char*)content_type_string);
-	const pj_str_t content_subtype=pj_str((char*)content_subtype_string);
-	const pj_str_t content={(char*)content_string,sizeof(content_string)}; //note NOT STRLEN!!!
-
-	alt_part = pjsip_multipart_create_part(pool);
-	alt_part->body = pjsip_msg_body_create(pool, &content_type,
-			&content_subtype, &content);
-
-	pjsua_msg_data_init(msg_data);
-
-	msg_data->multipart_ctype.type = pj_str((char*)"multipart");
-	msg_data->multipart_ctype.subtype = pj_str((char*)"mixed");
-	pj_list_push_back(&msg_data->multipart_parts, alt_part);
-}
-
-//the CON ISUP message to append on the reply - its always the same
-void add_SIP_I_ANM_Mime(pj_pool_t* pool, pjsua_msg_data *msg_data)
-{
-	pjsip_multipart_part *alt_part;
-	const char* content_type_string = "application";
-	const char* content_subtype_string = "ISUP; version=itu-t92+ \nContent-Disposition: signal; handling=required";
-	//ANM - no optional bytes
-	const char content_string[] = { 0x09, 0x00 };
-
-	const pj_str_t content_type=pj_str((char*)content_type_string);
-	const pj_str_t content_subtype=pj_str((char*)content_subtype_string);
-	const pj_str_t content={(char*)content_string,sizeof(content_string)}; //note NOT STRLEN!!!
-
-	alt_part = pjsip_multipart_create_part(pool);
-	alt_part->body = pjsip_msg_body_create(pool, &content_type,
-			&content_subtype, &content);
-
-	pjsua_msg_data_init(msg_data);
-
-	msg_data->multipart_ctype.type = pj_str((char*)"multipart");
-	msg_data->multipart_ctype.subtype = pj_str((char*)"mixed");
-	pj_list_push_back(&msg_data->multipart_parts, alt_part);
-}
-
 /*
  * This callback is called when media transport needs to be created.
  */
@@ -733,6 +622,23 @@ static pjmedia_transport* on_create_media_transport(pjsua_call_id call_id,
 	pjmedia_transport *adapter;
 	pj_status_t status;
 
+	//pjsua has opened the sockets of base_tp before asking us - they are ours to close, and closing them now keeps
+	//the call from holding any
+	if (signalling_only)
+	{
+		pjmedia_transport *null_tp;
+
+		if (flags & PJSUA_MED_TP_CLOSE_MEMBER)
+			pjmedia_transport_close(base_tp);
+
+		status = NullMediaTransport::Create(pjsua_get_pjmedia_endpt(), &null_tp);
+		if (status != PJ_SUCCESS) {
+			PJ_PERROR(1,(THIS_FILE, status, "Error creating null media transport"));
+			return NULL;
+		}
+		return null_tp;
+	}
+
 	/* Create the adapter */
 	status = pjmedia_tp_adapter_create(pjsua_get_pjmedia_endpt(),
 			NULL, base_tp,
@@ -743,6 +649,10 @@ static pjmedia_transport* on_create_media_transport(pjsua_call_id call_id,
 		return NULL;
 	}
 
+	((struct tp_adapter*)adapter)->stats = RtpStats::Bind(call_id);
+	((struct tp_adapter*)adapter)->capture = PacketCapture::SampleCall();
+	((struct tp_adapter*)adapter)->rx_shard = RtpShards::Assign();
+
 	PJ_LOG(3,(THIS_FILE, "Media transport is created for call %d media %d",
 			call_id, media_idx));
 
@@ -754,13 +664,8 @@ static void on_incoming_call(pjsua_acc_id acc_id, pjsua_call_id call_id,
 		pjsip_rx_data *rdata)
 {
 	pjsua_call_info ci;
-	char buffer[1024];
-
-	pjsip_media_type ISUP_TYPE;
-	ISUP_TYPE.type = pj_str((char*)"application");
-	ISUP_TYPE.subtype = pj_str((char*)"ISUP");
-
 
+	static pjsip_media_type ISUP_TYPE = { pj_str((char*)"application"), pj_str((char*)"ISUP") };
 
 	PJ_UNUSED_ARG(acc_id);
 
@@ -770,23 +675,78 @@ static void on_incoming_call(pjsua_acc_id acc_id, pjsua_call_id call_id,
 	PJ_LOG(3,(THIS_FILE, "Incoming call from %.*s!!",
 			(int)ci.remote_info.slen,
 			ci.remote_info.ptr));
-	pjsip_multipart_part* part = pjsip_multipart_find_part(rdata->msg_info.msg->body,&ISUP_TYPE,0);
-	pj_memcpy(buffer,part->body->data,part->body->len);
+
+	//decode the IAM in place - the view points straight into the received body
+	LocalCallUserData* callUserData = LocalCallUserData::LookupByCall(call_id);
+	pjsip_msg_body* body = rdata->msg_info.msg->body;
+	pjsip_multipart_part* part = NULL;
+	IsupView iam;
+
+	if (body && pj_stricmp2(&body->content_type.type, "multipart") == 0)
+		part = pjsip_multipart_find_part(body,&ISUP_TYPE,NULL);
+
+	if (!part || !part->body || !part->body->data)
+	{
+		PJ_LOG(2,(THIS_FILE, "Call %d has no ISUP body", call_id));
+	}
+	else if (!IsupDecoder::Decode((const uint8_t*)part->body->data, part->body->len, iam) ||
+			iam.type != eIsupMessageType::IAM)
+	{
+		PJ_LOG(2,(THIS_FILE, "Call %d ISUP body is not a valid IAM (%u bytes)", call_id, part->body->len));
+	}
+	else if (callUserData)
+	{
+		size_t n = iam.called.Digits(callUserData->called_number, sizeof(callUserData->called_number) - 1);
+		callUserData->called_number[n] = 0;
+		PJ_LOG(4,(THIS_FILE, "Call %d IAM for %s", call_id, callUserData->called_number));
+	}
 
 
 	pjsua_msg_data msg_data;
+	pjsip_multipart_part anm_part;
 
-	//NOTE THAT USER DATA IS ALREADY ALLOCATED in on_call_sdp_created
-	//	add_SIP_I_CON_Mime(LocalCallUserData::LookupByCall(call_id)->pool,&msg_data);
-	add_SIP_I_ANM_Mime(LocalCallUserData::LookupByCall(call_id)->pool,&msg_data);
+	//	IsupBodyCache::Attach(eIsupBody::CON,&anm_part,&msg_data);
+	IsupBodyCache::Attach(eIsupBody::ANM,&anm_part,&msg_data);
 
 	/* Automatically answer incoming calls with 200/OK */
 	pjsua_call_answer(call_id, 200, NULL, &msg_data);
 }
 
-static std::vector<uint64_t> statuscode_counter(1000,0);
+//keep the connection pool's count of requests awaiting a response up to date for a call we placed
+static void track_pooled_request(LocalCallUserData* call, pjsip_transaction *tsx, pjsip_event *e)
+{
+	uint64_t* sent_us;
+
+	if (call->connection < 0 || tsx->role != PJSIP_ROLE_UAC)
+		return;
+
+	if (tsx->method.id == PJSIP_INVITE_METHOD)
+		sent_us = &call->pool_invite_us;
+	else if (tsx->method.id == PJSIP_BYE_METHOD)
+		sent_us = &call->pool_bye_us;
+	else
+		return;
+
+	if (tsx->state == PJSIP_TSX_STATE_CALLING && !*sent_us)
+	{
+		*sent_us = CallLatency::Now();
+		ConnectionPool::RequestSent(call->connection);
+	}
+	else if (*sent_us && e->body.tsx_state.type == PJSIP_EVENT_RX_MSG)
+	{
+		ConnectionPool::ResponseReceived(call->connection, CallLatency::Now() - *sent_us);
+		*sent_us = 0;
+	}
+	else if (*sent_us && tsx->state >= PJSIP_TSX_STATE_COMPLETED)
+	{
+		//timed out or the connection failed - it is not coming back
+		ConnectionPool::RequestAbandoned(call->connection);
+		*sent_us = 0;
+	}
+}
 
 static std::atomic<int> ctr(0); //number of calls in the system - assume this can be atomically incremented in multithread context
+static std::atomic<uint64_t> answered(0); //calls that have ever reached CONFIRMED
 
 
 /* Callback called by the library when call's state has changed */
@@ -794,31 +754,76 @@ static void on_call_state(pjsua_call_id call_id, pjsip_event *e)
 {
 	pjsua_call_info ci;
 
-	PJ_UNUSED_ARG(e);
-
-
 	pjsua_call_get_info(call_id, &ci);
 	PJ_LOG(3,(THIS_FILE, "Call %d state=%.*s", call_id,
 			(int)ci.state_text.slen,
 			ci.state_text.ptr));
 	LocalCallUserData* call;
 
+	if (ci.state != PJSIP_INV_STATE_DISCONNECTED)
+		CallRegistry::Update(ci, LocalCallUserData::LookupByCall(call_id));
+
 	switch (ci.state)
 	{
 	case  PJSIP_INV_STATE_CALLING :
 	case  PJSIP_INV_STATE_INCOMING :
 		break;
+	case PJSIP_INV_STATE_CONNECTING :
+		//the 200 OK to the INVITE has just been received (placed calls) or sent (received calls)
+		call = LocalCallUserData::LookupByCall(call_id);
+		if (call)
+		{
+			call->answered_us = CallLatency::Now();
+			if (call->invite_sent_us)
+				CallLatency::Record(eLatencyMilestone::INVITE_200, call->answered_us - call->invite_sent_us);
+		}
+		break;
 	case PJSIP_INV_STATE_CONFIRMED :
-		LocalCallUserData::LookupByCall(call_id)->SaveSDP();
-		++ctr;
+		call = LocalCallUserData::LookupByCall(call_id);
+		if (call)
+		{
+			if (call->answered_us)
+				CallLatency::Record(eLatencyMilestone::ANSWER_ACK, CallLatency::Now() - call->answered_us);
+			call->SaveSDP();
+			++ctr; //paired with the decrement at DISCONNECTED, which goes by the confirmed flag SaveSDP sets
+		}
+		++answered;
 		break;
 	case PJSIP_INV_STATE_DISCONNECTED :
 	{
 		call = LocalCallUserData::LookupByCall(call_id);
+
+		//pjsip moves the call to DISCONNECTED as the response to our BYE (or a failure response to our INVITE)
+		//arrives - before on_call_tsx_state hears of it
+		if (call && e && e->type == PJSIP_EVENT_TSX_STATE)
+		{
+			pjsip_transaction* tsx = e->body.tsx_state.tsx;
+			if (call->bye_sent_us && tsx->role == PJSIP_ROLE_UAC && tsx->method.id == PJSIP_BYE_METHOD && tsx->status_code/100 == 2)
+				CallLatency::Record(eLatencyMilestone::BYE_200, CallLatency::Now() - call->bye_sent_us);
+			track_pooled_request(call, tsx, e);
+		}
+
+		//anything still outstanding on the connection never will be answered now
+		if (call && call->connection >= 0)
+		{
+			if (call->pool_invite_us)
+				ConnectionPool::RequestAbandoned(call->connection);
+			if (call->pool_bye_us)
+				ConnectionPool::RequestAbandoned(call->connection);
+		}
+
 		if(call && call->confirmed)
 			ctr--;
-		statuscode_counter[ci.last_status]++;
-		delete call;
+		if (call)
+			DisconnectStats::Record(call->callType,
+					call->callType == +eCallType::RECEIVED_CALL ?
+							call->agentDir == +eAgentDirectionType::ANSWER_BI_DIRECTIONAL :
+							call->simDir == +eSimulatorDirectionType::SIMULATE_BI_DIRECTIONAL,
+					ci.last_status);
+		else
+			DisconnectStats::Record(eCallType::UNINITIALISED, false, ci.last_status);
+		CallContextSlab::Release(call);
+		CallRegistry::Remove(call_id);
 		break;
 	}
 	default:
@@ -827,6 +832,57 @@ static void on_call_state(pjsua_call_id call_id, pjsip_event *e)
 	}
 }
 
+/* Callback called by the library when a transaction within a call changes state - the provisional responses to our
+ * INVITE never change the call state, so this is the only place we see them
+ */
+static void on_call_tsx_state(pjsua_call_id call_id, pjsip_transaction *tsx, pjsip_event *e)
+{
+	if (tsx->role != PJSIP_ROLE_UAC || e->type != PJSIP_EVENT_TSX_STATE)
+		return;
+
+	LocalCallUserData* call = LocalCallUserData::LookupByCall(call_id);
+	if (!call)
+		return;
+
+	track_pooled_request(call, tsx, e);
+
+	if (tsx->method.id == PJSIP_BYE_METHOD)
+	{
+		if (tsx->state == PJSIP_TSX_STATE_CALLING && !call->bye_sent_us)
+			call->bye_sent_us = CallLatency::Now();
+		return;
+	}
+
+	if (tsx->method.id != PJSIP_INVITE_METHOD || e->body.tsx_state.type != PJSIP_EVENT_RX_MSG || !call->invite_sent_us)
+		return;
+
+	//only the first of each - retransmitted or repeated provisionals say nothing about how quick the far end is
+	if (tsx->status_code == 100 && !call->got_100)
+	{
+		call->got_100 = true;
+		CallLatency::Record(eLatencyMilestone::INVITE_100, CallLatency::Now() - call->invite_sent_us);
+	}
+	else if ((tsx->status_code == 180 || tsx->status_code == 183) && !call->got_18x)
+	{
+		call->got_18x = true;
+		CallLatency::Record(eLatencyMilestone::INVITE_18X, CallLatency::Now() - call->invite_sent_us);
+	}
+}
+
+//the stream is started by now - DirectMedia takes it if it is running, and the bridge gets it otherwise, clocked by
+//the null sound device as ever
+static void on_stream_created(pjsua_call_id call_id, pjmedia_stream *strm, unsigned stream_idx, pjmedia_port **p_port)
+{
+	if (stream_idx == 0 && DirectMedia::Running() && !DirectMedia::Attach(call_id, strm, *p_port))
+		PJ_LOG(4,(THIS_FILE, "Stream of call %d cannot be driven directly - it goes through the bridge", call_id));
+}
+
+static void on_stream_destroyed(pjsua_call_id call_id, pjmedia_stream *strm, unsigned stream_idx)
+{
+	if (stream_idx == 0)
+		DirectMedia::Detach(call_id);
+}
+
 /* Callback called by the library when call's media state has changed */
 static void on_call_media_state(pjsua_call_id call_id)
 {
@@ -840,11 +896,20 @@ static void on_call_media_state(pjsua_call_id call_id)
 
 	pjsua_call_get_info(call_id, &ci);
 
+	CallRegistry::UpdateMedia(call_id, ci.media_status, ci.media_dir);
 
-	if (ci.media_status == PJSUA_CALL_MEDIA_ACTIVE) {
-		// When media is active, connect call to sound device.
+	//a re-INVITE leaves a new local SDP active - keep the one we render from current
+	LocalCallUserData* userData = LocalCallUserData::LookupByCall(call_id);
+	if (userData && userData->confirmed)
+		userData->SaveSDP();
+
+	//inactive media is still active to pjsua - but there is no stream to connect or pause
+	if (ci.media_status == PJSUA_CALL_MEDIA_ACTIVE && !signalling_only) {
+		// When media is active, connect call to sound device - unless DirectMedia is feeding the stream, when the
+		// port stays in the bridge unconnected and the bridge never touches it
 		// pjsua_conf_connect(ci.conf_slot, 0);
-		pjsua_conf_connect(0, ci.conf_slot);
+		if (!DirectMedia::Attached(call_id))
+			pjsua_conf_connect(0, ci.conf_slot);
 
 
 		PJSUA_LOCK();
@@ -873,65 +938,95 @@ static void on_call_sdp_created (pjsua_call_id call_id, pjmedia_sdp_session *sdp
 	LocalCallUserData* userData = LocalCallUserData::LookupByCall(call_id);
 
 	//if there is no user data allocated it is because we are answering a call - and call_sdp_created is called PRIOR to on_incoming call
-	//so we need to allocate a call structure and save it
+	//so we need to claim a call structure and save it
+	//if this is a call we are placing the user data is still the OutgoingCallRequest handed to pjsua_call_make_call
 	if (!userData)
 	{
-		userData = new LocalCallUserData;
+		auto request = (const OutgoingCallRequest*)pjsua_call_get_user_data(call_id);
 
-		userData->callType=eCallType::RECEIVED_CALL;
+		userData = CallContextSlab::Acquire(call_id);
+		if (!userData)
+			return;
 
-		userData->BindToCall(call_id);
+		if (request)
+		{
+			userData->callType=request->callType;
+			userData->simDir=request->simDir;
+			userData->connection=request->connection;
+			userData->BindToCall(call_id);
+			userData->SetHangupTimer(request->hold_ms);
+			userData->invite_sent_us = CallLatency::Now(); //pjsua sends the INVITE as soon as the SDP is done
+		}
+		else
+		{
+			userData->callType=eCallType::RECEIVED_CALL;
+			userData->BindToCall(call_id);
+		}
 	}
 
+	//the direction attribute is all that differs between our modes - pjsua has filled in the ports and addresses
+	//from the call's media transport already
 	if (userData->callType == +eCallType::RECEIVED_CALL)
-	{
-		if(userData->agentDir == +eAgentDirectionType::ANSWER_UNI_DIRECTIONAL)
-		{
-			//need to generate an SDP suppressing the TX audio
-			//for each media line change a=sendrecv to a=sendonly
-			for (uint16_t i=0; i<sdp->media_count; i++)
-			{
-				auto attr = pjmedia_sdp_media_find_attr2(sdp->media[i],"sendrecv",0);
-				if (attr)
-				{
-					pjmedia_sdp_media_remove_attr(sdp->media[i],attr);
-					attr=pjmedia_sdp_attr_create(pool,"recvonly",0);
-					pjmedia_sdp_media_add_attr (sdp->media[i],attr);
-				}
-			}
+		SdpTemplates::ApplyDirection(sdp, userData->agentDir);
+	else
+		SdpTemplates::ApplyDirection(sdp, userData->simDir);
 
-		}
+}
 
 
-	}
-	else
-	{
-		if(userData->simDir == +eSimulatorDirectionType::SIMULATED_UNI_DIRECTIONAL)
-		{
-			//need to generate an SDP suppressing the RX audio
-			//for each media line change a=sendrecv to a=recvonly
-			for (uint16_t i=0; i<sdp->media_count; i++)
-			{
-				auto attr = pjmedia_sdp_media_find_attr2(sdp->media[i],"sendrecv",0);
-				if (attr)
-				{
-					pjmedia_sdp_media_remove_attr(sdp->media[i],attr);
-					attr=pjmedia_sdp_attr_create(pool,"sendonly",0);
-					pjmedia_sdp_media_add_attr (sdp->media[i],attr);
-				}
-			}
-		}
 
-	}
-}
 
 
 
 
 
 
+static void print_latency()
+{
+	std::unique_ptr<LatencyHistogram::Snapshot> latency(new LatencyHistogram::Snapshot);
+
+	printf("Latency (us)         count      p50      p90      p99    p99.9      max\n");
+	for (auto milestone : eLatencyMilestone::_values())
+	{
+		CallLatency::Take(milestone, *latency);
+		printf("%-12s %13lu %8lu %8lu %8lu %8lu %8lu\n", milestone._to_string(), latency->count,
+				latency->Percentile(0.5), latency->Percentile(0.9),
+				latency->Percentile(0.99), latency->Percentile(0.999), latency->max);
+	}
+}
 
+static void print_cleared_calls()
+{
+	std::unique_ptr<DisconnectStats::Snapshot> cleared(new DisconnectStats::Snapshot);
+	DisconnectStats::Take(*cleared);
 
+	printf("Calls cleared with reason (%lu total):\n", cleared->total);
+	for(unsigned i=0; i<DisconnectStats::CODES; i++)
+	{
+		uint64_t count = cleared->ByCode(i);
+		if (count > 0 && pjsip_get_status_text2(i)!=0)
+		{
+			printf("%s %lu\n",pjsip_get_status_text2(i)->ptr,count);
+		}
+	}
+
+	for (auto type : eCallType::_values())
+	{
+		for (unsigned dir=0; dir<DisconnectStats::DIRECTIONS; dir++)
+		{
+			if (cleared->ByType(type._to_integral(),dir) == 0)
+				continue;
+
+			printf("%s %s:\n", type._to_string(), dir ? "bi-directional" : "uni-directional");
+			for(unsigned i=0; i<DisconnectStats::CODES; i++)
+			{
+				uint64_t count = cleared->counts[type._to_integral()][dir][i];
+				if (count > 0 && pjsip_get_status_text2(i)!=0)
+					printf("  %s %lu\n",pjsip_get_status_text2(i)->ptr,count);
+			}
+		}
+	}
+}
 
 int main(int argc, char** argv)
 {
@@ -940,14 +1035,114 @@ int main(int argc, char** argv)
 
 	std::string uri_to_call_string;
 	int log_level;
+	unsigned max_calls;
+	CallGeneratorConfig gen_cfg;
+	eConnectionPooling pooling = eConnectionPooling::SHARED;
+	std::string arrival_string;
+	std::string hold_dist_string;
+	std::string burst_script;
+	unsigned bench_isup;
+	std::string called_number;
+	std::string calling_number;
+	unsigned short metrics_port;
+	unsigned metrics_interval_ms;
+	unsigned workers;
+	std::string shard_string;
+	unsigned first_cpu;
+	std::vector<std::string> listen_specs;
+	std::string call_transport_string;
+	TlsFiles tls_files;
+	std::string pooling_string;
+	unsigned pool_connections;
+	unsigned calls_per_connection;
+	std::string sdp_retention_string;
+	eSdpRetention sdp_retention = eSdpRetention::LAZY;
+	std::string payload_string;
+	ePayloadSource payload_source = ePayloadSource::CODEC;
+	unsigned payload_tone_hz;
+	std::string payload_file;
+	size_t sdp_bytes;
+	PcapConfig pcap;
+	uint64_t pcap_rotate_mb;
+	unsigned rtp_pacing_us;
+	unsigned rtp_batch;
+	unsigned rtp_burst;
+	unsigned rx_shards;
+	unsigned short rx_port;
+	unsigned rx_first_cpu;
+	unsigned rx_batch;
+	unsigned bench_sec;
+	bool search;
+	CpsSearchConfig search_cfg;
+	unsigned search_window_sec;
 
 	po::options_description desc;
 	desc.add_options()
 				("help,h", "Help screen")
-				("port,p",po::value(&port)->default_value(5060),"sip port to listen on")
+				("port,p",po::value(&port)->default_value(5060),"sip port to listen on when no --listen is given")
+				("listen", po::value(&listen_specs)->composing(),"listener to open as transport[:port] - udp, tcp or tls - may be given more than once. Default tcp:--port")
+				("transport", po::value(&call_transport_string),"client: transport to place calls over - udp, tcp or tls. Default that of the first --listen")
+				("tls-cert", po::value(&tls_files.cert),"certificate for tls listeners - a self signed one will do: openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 365 -subj /CN=localhost")
+				("tls-key", po::value(&tls_files.key),"private key for tls listeners")
+				("tls-ca", po::value(&tls_files.ca),"CA list for tls, only needed to verify the far end")
+				("tls-password", po::value(&tls_files.password),"password for an encrypted --tls-key")
+				("pooling", po::value(&pooling_string)->default_value("shared"),"client: how calls are spread over tcp/tls connections - shared (one connection), fixed (--connections of them) or per_calls (one per --calls-per-connection calls)")
+				("connections", po::value(&pool_connections)->default_value(4),"client: connections for --pooling fixed")
+				("calls-per-connection", po::value(&calls_per_connection)->default_value(100),"client: calls placed per connection for --pooling per_calls")
 				("server", "activate server thread")
 				("client", po::value(&uri_to_call_string)->default_value(std::string("sip:+12345@127.0.0.1;user=phone")),"activate client thread")
 				("loglevel,l", po::value(&log_level)->default_value(2),"log level to be used from 1 to 5")
+				("max-calls", po::value(&max_calls)->default_value(1200),"maximum number of simultaneous calls pjsua will handle")
+				("cps", po::value(&gen_cfg.cps)->default_value(2.0),"client: calls per second to offer once ramped up")
+				("ramp-up", po::value(&gen_cfg.ramp_up_sec)->default_value(0.0),"client: seconds to ramp linearly from 0 to --cps")
+				("calls", po::value(&gen_cfg.total_calls)->default_value(150),"client: total number of calls to attempt, 0 for no limit")
+				("concurrency", po::value(&gen_cfg.max_concurrent)->default_value(0),"client: do not offer new calls while this many are in progress, 0 for no limit")
+				("arrival", po::value(&arrival_string)->default_value("constant"),"client: call arrival model - constant, poisson or burst")
+				("bursts", po::value(&burst_script),"client: burst script for --arrival burst - offset_sec:count[:spread_ms],...")
+				("burst-period", po::value(&gen_cfg.burst_period_sec)->default_value(0.0),"client: repeat the burst script every this many seconds, 0 to play it once")
+				("seed", po::value(&gen_cfg.seed)->default_value(0),"client: seed for the arrival and hold time generators, 0 for a random seed")
+				("hold", po::value(&gen_cfg.hold_mean_sec)->default_value(300.0),"client: mean seconds before a placed call is hung up")
+				("hold-dist", po::value(&hold_dist_string)->default_value("fixed"),"client: hold time distribution - fixed, exponential, uniform or lognormal")
+				("hold-min", po::value(&gen_cfg.hold_min_sec)->default_value(0.0),"client: shortest hold time in seconds (lower bound for uniform)")
+				("hold-max", po::value(&gen_cfg.hold_max_sec)->default_value(86400.0),"client: longest hold time in seconds (upper bound for uniform)")
+				("hold-sigma", po::value(&gen_cfg.hold_sigma)->default_value(1.0),"client: shape parameter for the lognormal hold time")
+				("called-number", po::value(&called_number)->default_value("0396504232"),"client: IAM called party number - each x is replaced by a digit of the call sequence number")
+				("calling-number", po::value(&calling_number)->default_value("418702172"),"client: IAM calling party number - each x is replaced by a digit of the call sequence number")
+				("sdp-retention", po::value(&sdp_retention_string)->default_value("lazy"),"what to keep of each confirmed call's SDP for the l command - off, lazy (printed when listed) or eager (printed as the call is confirmed)")
+				("sdp-bytes", po::value(&sdp_bytes)->default_value(1024),"with --sdp-retention eager: bytes of SDP text kept per call")
+				("pcap", po::value(&pcap.prefix),"capture RTP and RTCP to pcap files named after this prefix - prefix-0001.pcap and on")
+				("pcap-payload", po::bool_switch(&pcap.payload),"with --pcap: capture whole RTP packets rather than just their headers")
+				("pcap-calls", po::value(&pcap.every_call)->default_value(1),"with --pcap: capture one call in this many")
+				("pcap-packets", po::value(&pcap.every_packet)->default_value(1),"with --pcap: capture one packet in this many of each captured call")
+				("pcap-rotate-mb", po::value(&pcap_rotate_mb)->default_value(100),"with --pcap: start a new file once the current one has this many MB, 0 for one file")
+				("pcap-files", po::value(&pcap.keep_files)->default_value(10),"with --pcap: keep only this many files, deleting the oldest - 0 to keep every one")
+				("rtp-pacing-us", po::value(&rtp_pacing_us)->default_value(0),"send RTP from a pacing thread that wakes this often, batching with sendmmsg - 0 to send each packet as it is encoded")
+				("rtp-batch", po::value(&rtp_batch)->default_value(64),"with --rtp-pacing-us: most packets handed to one sendmmsg")
+				("rtp-burst", po::value(&rtp_burst)->default_value(0),"with --rtp-pacing-us: most packets sent each time the pacer wakes, 0 for no limit")
+				("rx-shards", po::value(&rx_shards)->default_value(0),"server: receive RTP on this many shared sockets, each read with recvmmsg by a thread on a core of its own, rather than a socket per call - 0 for a socket per call")
+				("rx-port", po::value(&rx_port)->default_value(20000),"with --rx-shards: port of the first shard, the rest follow on")
+				("rx-first-cpu", po::value(&rx_first_cpu)->default_value(0),"with --rx-shards: pin shard n to CPU rx-first-cpu + n")
+				("rx-batch", po::value(&rx_batch)->default_value(64),"with --rx-shards: most datagrams taken by one recvmmsg")
+				("bench", po::value(&bench_sec)->default_value(0),"run a loopback capacity test for this many seconds - a forked UAS answers on --listen while we generate calls at it, then print one report and exit. --calls defaults to no limit")
+				("signalling-only", po::bool_switch(&signalling_only),"negotiate every call's media inactive on a transport with no sockets, and never start a stream - for the capacity of the SIP and ISUP alone")
+				("direct-media", po::bool_switch(&direct_media),"feed each call's stream from a per call source and drain it into a counting sink, on a clock per media thread, rather than through the conference bridge")
+				("payload", po::value(&payload_string)->default_value("codec"),"with --direct-media: codec (silence through the stream's encoder), or G.711 frames encoded once at startup and sent with just a new RTP header - silence, tone or file")
+				("payload-tone-hz", po::value(&payload_tone_hz)->default_value(1000),"with --payload tone: frequency of the tone")
+				("payload-file", po::value(&payload_file),"with --payload file: WAV or raw 16 bit PCM, 8kHz mono, looped")
+				("search", po::bool_switch(&search),"client: find the highest CPS that stays within --slo-fail-pct and --slo-p99-ms, print the CPS against latency curve and exit. With --bench, against the loopback UAS")
+				("search-start", po::value(&search_cfg.start_cps)->default_value(10.0),"with --search: first CPS tried")
+				("search-factor", po::value(&search_cfg.factor)->default_value(2.0),"with --search: step the CPS up by this factor until a step fails, then bisect")
+				("search-precision", po::value(&search_cfg.precision)->default_value(0.05),"with --search: stop once the failing CPS is within this fraction of the passing one")
+				("search-max-cps", po::value(&search_cfg.max_cps)->default_value(100000.0),"with --search: never offer more than this")
+				("search-window", po::value(&search_window_sec)->default_value(30),"with --search: seconds each CPS is held for - keep --hold well inside it")
+				("slo-fail-pct", po::value(&search_cfg.slo_fail_pct)->default_value(1.0),"with --search: most calls in a step that may be refused or cleared with anything but a 2xx")
+				("slo-p99-ms", po::value(&search_cfg.slo_p99_ms)->default_value(500.0),"with --search: highest p99 INVITE to 200 OK in a step")
+				("bench-isup", po::value(&bench_isup)->default_value(0),"time building the ISUP IAM per call against the cached body over this many iterations, then exit")
+				("metrics-port", po::value(&metrics_port)->default_value(0),"serve Prometheus (/metrics) and JSON (/metrics.json) metrics on this port on 127.0.0.1, 0 to disable")
+				("metrics-interval", po::value(&metrics_interval_ms)->default_value(1000),"milliseconds between refreshes of the metrics being served")
+				("workers", po::value(&workers)->default_value(1),"fork this many worker processes, each with its own pjsua pinned to its own CPU - the calls, rates and limits are shared out between them")
+				("shard", po::value(&shard_string)->default_value("reuseport"),"with --workers: reuseport to all listen on --port, or ports for worker n to listen on --port + n")
+				("first-cpu", po::value(&first_cpu)->default_value(0),"with --workers: pin worker n to CPU first-cpu + n")
 				;
 
 
@@ -964,6 +1159,181 @@ int main(int argc, char** argv)
 		exit(-1);
 	}
 
+	if (vm.count("help"))
+	{
+		std::cout << desc << std::endl;
+		return 0;
+	}
+
+	{
+		auto arrival = eArrivalModel::_from_string_nocase_nothrow(arrival_string.c_str());
+		auto holdDist = eHoldDistribution::_from_string_nocase_nothrow(hold_dist_string.c_str());
+		if (!arrival || !holdDist)
+		{
+			std::cerr << "unknown --arrival or --hold-dist" << std::endl;
+			exit(-1);
+		}
+		gen_cfg.arrival = *arrival;
+		gen_cfg.holdDist = *holdDist;
+
+		auto mode = eConnectionPooling::_from_string_nocase_nothrow(pooling_string.c_str());
+		if (!mode)
+		{
+			std::cerr << "unknown --pooling" << std::endl;
+			exit(-1);
+		}
+		pooling = *mode;
+
+		auto retention = eSdpRetention::_from_string_nocase_nothrow(sdp_retention_string.c_str());
+		if (!retention || sdp_bytes == 0)
+		{
+			std::cerr << "unknown --sdp-retention, or --sdp-bytes 0" << std::endl;
+			exit(-1);
+		}
+		sdp_retention = *retention;
+
+		auto payload = ePayloadSource::_from_string_nocase_nothrow(payload_string.c_str());
+		if (!payload || (*payload == +ePayloadSource::FILE && payload_file.empty()))
+		{
+			std::cerr << "unknown --payload, or --payload file without a --payload-file" << std::endl;
+			exit(-1);
+		}
+		payload_source = *payload;
+
+		for (auto number : { &called_number, &calling_number })
+		{
+			if (number->empty() || number->size() > 30 || number->find_first_not_of("0123456789xX") != std::string::npos)
+			{
+				std::cerr << "party numbers must be 1 to 30 digits, with x for the digits taken from the call sequence number" << std::endl;
+				exit(-1);
+			}
+		}
+
+		if (gen_cfg.arrival == +eArrivalModel::BURST && !CallGeneratorConfig::ParseBurstScript(burst_script, gen_cfg.bursts))
+		{
+			std::cerr << "--arrival burst needs a --bursts script of the form offset_sec:count[:spread_ms],... with every count at least 1" << std::endl;
+			exit(-1);
+		}
+
+		if (gen_cfg.hold_min_sec < 0.0 || gen_cfg.hold_max_sec < 0.0 || gen_cfg.hold_min_sec > gen_cfg.hold_max_sec)
+		{
+			std::cerr << "--hold-min and --hold-max cannot be negative, and --hold-min cannot be above --hold-max" << std::endl;
+			exit(-1);
+		}
+
+		//the hold time goes to the hangup timer as uint32_t milliseconds - anything that would not fit, or a
+		//distribution that would hand back NaN, has to be turned away here
+		if (gen_cfg.hold_max_sec > UINT32_MAX / 1000.0 || gen_cfg.hold_sigma <= 0.0 ||
+				(gen_cfg.hold_mean_sec <= 0.0 &&
+						(gen_cfg.holdDist == +eHoldDistribution::EXPONENTIAL || gen_cfg.holdDist == +eHoldDistribution::LOGNORMAL)))
+		{
+			std::cerr << "--hold-max cannot be above " << UINT32_MAX / 1000 << ", --hold-sigma has to be above 0, and --hold has to be above 0 for exponential and lognormal hold times" << std::endl;
+			exit(-1);
+		}
+	}
+
+	bool server = vm.count("server") > 0;
+
+	if (search && (server || workers > 1 || search_cfg.factor <= 1.0 || search_cfg.start_cps <= 0 || search_window_sec == 0 ||
+			search_cfg.precision <= 0.0 || search_cfg.max_cps < search_cfg.start_cps))
+	{
+		std::cerr << "--search is for a single client process, with a --search-factor above 1, a --search-start, --search-precision and "
+				"--search-window above 0 and a --search-max-cps no lower than --search-start" << std::endl;
+		exit(-1);
+	}
+	search_cfg.window = std::chrono::seconds(search_window_sec);
+
+	if (payload_source != +ePayloadSource::CODEC && !direct_media)
+	{
+		std::cerr << "--payload needs --direct-media - through the bridge every frame is encoded" << std::endl;
+		exit(-1);
+	}
+
+	if (signalling_only && direct_media)
+	{
+		std::cerr << "--signalling-only has no streams for --direct-media to drive" << std::endl;
+		exit(-1);
+	}
+
+	if (signalling_only && (!pcap.prefix.empty() || rtp_pacing_us || rx_shards))
+	{
+		std::cerr << "--signalling-only has no RTP for --pcap, --rtp-pacing-us or --rx-shards" << std::endl;
+		exit(-1);
+	}
+
+	//the benchmark UAS is forked before pjsua too - from here on it is a server like any other, and we are its client
+	std::unique_ptr<LoopbackBench> bench;
+	bool bench_uas = false;
+	if (bench_sec)
+	{
+		if (workers > 1 || server)
+		{
+			std::cerr << "--bench runs the server itself, and cannot be shared between --workers" << std::endl;
+			exit(-1);
+		}
+		if (4000 + (uint64_t)max_calls * 4 > 65535)
+		{
+			std::cerr << "not enough RTP ports for the UAC and UAS of " << max_calls << " calls each" << std::endl;
+			exit(-1);
+		}
+		if (vm["calls"].defaulted())
+			gen_cfg.total_calls = 0;
+
+		bench.reset(new LoopbackBench);
+		bench_uas = bench->Fork();
+		server = bench_uas;
+
+		if (bench_uas)
+			metrics_port = 0;
+		else
+			rx_shards = 0; //the shards are for receiving - the UAS has them
+		if (!pcap.prefix.empty())
+			pcap.prefix += bench_uas ? "-uas" : "-uac";
+	}
+
+	//fork the workers before pjsua or anything else has started a thread - from here on a worker carries on as
+	//though it were the only process, with its share of the load
+	std::unique_ptr<ShardSupervisor> supervisor;
+	int worker = -1;
+	eShardMode shard_mode = eShardMode::REUSEPORT;
+	if (workers > 1)
+	{
+		auto mode = eShardMode::_from_string_nocase_nothrow(shard_string.c_str());
+		if (!mode)
+		{
+			std::cerr << "unknown --shard" << std::endl;
+			exit(-1);
+		}
+		shard_mode = *mode;
+
+		if (4000 + (uint64_t)workers * max_calls * 2 > 65535)
+		{
+			std::cerr << "not enough RTP ports for " << workers << " workers of " << max_calls << " calls each" << std::endl;
+			exit(-1);
+		}
+
+		supervisor.reset(new ShardSupervisor(workers));
+		worker = supervisor->Fork(first_cpu);
+		if (worker < 0)
+			return supervisor->Supervise();
+
+		if (metrics_port)
+			metrics_port += worker;
+		if (!pcap.prefix.empty())
+			pcap.prefix += "-w" + std::to_string(worker);
+		rx_port += worker * rx_shards;
+		rx_first_cpu += worker * rx_shards;
+
+		gen_cfg.cps /= workers;
+		gen_cfg.total_calls = gen_cfg.total_calls / workers + (worker < (int)(gen_cfg.total_calls % workers) ? 1 : 0);
+		if (gen_cfg.max_concurrent)
+			gen_cfg.max_concurrent = std::max(1u, gen_cfg.max_concurrent / workers);
+		for (auto& burst : gen_cfg.bursts)
+			burst.count = burst.count / workers + (worker < (int)(burst.count % workers) ? 1 : 0);
+		if (gen_cfg.seed)
+			gen_cfg.seed += worker; //reproducible, but not the same schedule in every worker
+	}
+
 	{
 		struct sched_param schedule;
 		schedule.__sched_priority = 10;
@@ -976,18 +1346,86 @@ int main(int argc, char** argv)
 	}
 
 
-	enum pjsip_transport_type_e transport;
+	//the listeners - and which of them the client places its calls over
+	std::vector<std::pair<eSipTransport, unsigned>> listeners;
+	eSipTransport call_transport = eSipTransport::TCP;
+	{
+		if (listen_specs.empty())
+			listen_specs.push_back("tcp:" + std::to_string(port));
+
+		for (auto& spec : listen_specs)
+		{
+			eSipTransport type = eSipTransport::TCP;
+			unsigned listen_port;
+			if (!SipTransports::ParseListener(spec, type, listen_port))
+			{
+				std::cerr << "bad --listen " << spec << " - expected udp, tcp or tls with an optional :port" << std::endl;
+				exit(-1);
+			}
+			if (worker >= 0 && shard_mode == +eShardMode::PORTS)
+				listen_port += worker;
+			listeners.push_back(std::make_pair(type, listen_port));
+		}
+
+		call_transport = listeners.front().first;
+		if (!call_transport_string.empty())
+		{
+			auto type = eSipTransport::_from_string_nocase_nothrow(call_transport_string.c_str());
+			if (!type)
+			{
+				std::cerr << "unknown --transport" << std::endl;
+				exit(-1);
+			}
+			call_transport = *type;
+		}
+
+		//pjsua can only send over a transport type it has a listener of
+		if (std::find_if(listeners.begin(), listeners.end(),
+				[call_transport](const std::pair<eSipTransport, unsigned>& listener) { return listener.first == call_transport; }) == listeners.end())
+		{
+			std::cerr << "--transport " << call_transport._to_string() << " needs a --listen of the same type" << std::endl;
+			exit(-1);
+		}
+	}
 
-	transport=PJSIP_TRANSPORT_TCP;
+	//the benchmark UAC calls the UAS on its listener, and listens where it can itself
+	if (bench && !bench_uas)
+	{
+		for (auto& listener : listeners)
+		{
+			if (listener.first == call_transport)
+			{
+				uri_to_call_string = "sip:" + called_number + "@127.0.0.1:" + std::to_string(listener.second) + ";user=phone";
+				break;
+			}
+		}
+		for (auto& listener : listeners)
+			listener.second = 0;
+	}
 
-	uri_to_call_string=uri_to_call_string + std::string(";transport=tcp");
+	uri_to_call_string=uri_to_call_string + ";transport=" + SipTransports::UriParam(call_transport);
 
 	pjsua_acc_id acc_id;
 
+	std::unique_ptr<CallGenerator> generator;
+	CallGenerator::PlaceCallFn place_call;
+	CallGenerator::ActiveCallsFn active_calls;
+
 
 	/* Create pjsua first! */
 	pjsua_create();
 
+	//the ISUP bodies are shared by every call - build them before anything can ask for one
+	IsupBodyCache::Init();
+	SdpTemplates::Init(signalling_only);
+
+	if (bench_isup)
+	{
+		IsupBodyCache::Benchmark(bench_isup);
+		pjsua_destroy();
+		return 0;
+	}
+
 
 	/* Init pjsua */
 	{
@@ -1002,16 +1440,19 @@ int main(int argc, char** argv)
 		ua_cfg.cb.on_incoming_call = &on_incoming_call;
 		ua_cfg.cb.on_call_media_state = &on_call_media_state;
 		ua_cfg.cb.on_call_state = &on_call_state;
+		ua_cfg.cb.on_call_tsx_state = &on_call_tsx_state;
 		ua_cfg.cb.on_create_media_transport=&on_create_media_transport;
 		ua_cfg.cb.on_call_sdp_created=&on_call_sdp_created;
+		ua_cfg.cb.on_stream_created=&on_stream_created;
+		ua_cfg.cb.on_stream_destroyed=&on_stream_destroyed;
 
-		ua_cfg.max_calls = 1200;
+		ua_cfg.max_calls = max_calls;
 		ua_cfg.thread_cnt=2;
 
 		log_cfg.console_level = log_level;
 
 		media_cfg.no_vad = 1; //disable VAD
-		if (vm.count("server")==0)
+		if (!server)
 		{
 			media_cfg.thread_cnt=2;
 			ua_cfg.require_100rel=PJSUA_100REL_MANDATORY; //we will force 100 TRYING to be generated - this is really for testing purposes
@@ -1023,22 +1464,61 @@ int main(int argc, char** argv)
 			ua_cfg.require_100rel=PJSUA_100REL_OPTIONAL; //if we a server support 100 TRYING if the client wants it
 		}
 
+		//no media sockets to poll - and the per call ones pjsua opens are closed before they are ever polled
+		if (signalling_only)
+		{
+			media_cfg.has_ioqueue = PJ_FALSE;
+			media_cfg.thread_cnt = 0;
+		}
+
 		pjsua_init(&ua_cfg, &log_cfg, &media_cfg);
+
+		//a clock per media thread, each encoding for its share of the calls. 20ms of 8kHz - we force A law below, and
+		//a stream at anything else is left to the bridge
+		if (direct_media)
+		{
+			PayloadCache::Init(payload_source, payload_tone_hz, payload_file, 160);
+			DirectMedia::Start(media_cfg.thread_cnt, max_calls, 8000, 160);
+		}
 	}
 
+	if (signalling_only)
+		NullMediaTransport::Init();
+
 	pjsua_verify_url(uri_to_call_string.c_str());
 
-	{
-		/* Add transport. */
-		pjsua_transport_config cfg;
+	/* Add transports - when the workers share the ports the kernel hashes incoming traffic across their listeners */
+	for (auto& listener : listeners)
+		SipTransports::Listen(listener.first, listener.second, tls_files, worker >= 0 && shard_mode == +eShardMode::REUSEPORT);
 
-		pjsua_transport_config_default(&cfg);
-		cfg.port = port;
-		pjsua_transport_create(transport, &cfg, NULL);
 
-	}
 
+	//one call context per possible call id - built now so call setup never allocates
+	CallContextSlab::Init(max_calls, sdp_retention, sdp_bytes);
+	RtpStats::Init(max_calls);
+	CallRegistry::Init(max_calls);
+	CallContextSlab::StartTimers(std::chrono::milliseconds(10));
 
+	unsigned rtp_port_base = 4000 + (worker >= 0 ? worker * max_calls * 2 : 0); //4000 being pjsua's default
+	if (bench && !bench_uas)
+		rtp_port_base += max_calls * 2; //above the UAS
+
+	//before any media transport is created, so the first call can be sampled
+	pcap.rotate_bytes = pcap_rotate_mb * 1024 * 1024;
+	PacketCapture::Start(pcap);
+
+	if (rtp_pacing_us)
+		RtpPacer::Start(std::chrono::microseconds(rtp_pacing_us), rtp_batch, rtp_burst);
+
+	if (rx_shards)
+	{
+		if (rx_port + rx_shards > rtp_port_base && rx_port < rtp_port_base + max_calls * 2)
+		{
+			std::cerr << "--rx-port " << rx_port << " runs into the RTP ports from " << rtp_port_base << std::endl;
+			exit(-1);
+		}
+		RtpShards::Start(rx_shards, rx_port, rx_first_cpu, rx_batch, &transport_shard_cb);
+	}
 
 	/* Initialization is done, now start pjsua */
 	pjsua_start() ;
@@ -1050,15 +1530,29 @@ int main(int argc, char** argv)
 		pjsua_acc_config_default(&cfg);
 		cfg.id = pj_str((char*)"sip:" SIP_DOMAIN);
 
+		//give each worker its own run of RTP ports rather than have them all hunting up from the same one
+		cfg.rtp_cfg.port = rtp_port_base;
+
 		pjsua_acc_add(&cfg, PJ_TRUE, &acc_id);
 	}
+
+	if (!server)
+		ConnectionPool::Init(pooling, pool_connections, calls_per_connection, max_calls, call_transport, tls_files,
+				acc_id, rtp_port_base, max_calls * 2);
 	/* If URL is specified, make call to the URL. */
 
-	pjsua_set_null_snd_dev();
+	//the null sound device clocks the conference bridge from a thread of its own - with no streams there is nothing
+	//for it to clock. Direct media still needs it, for any stream DirectMedia turns down (another codec rate or
+	//ptime - the server does not force A law); the streams it does take sit in the bridge unconnected and cost the
+	//clock next to nothing
+	if (signalling_only)
+		pjsua_set_no_snd_dev();
+	else
+		pjsua_set_null_snd_dev();
 
 
 
-	if (vm.count("server")==0)
+	if (!server)
 	{
 		//this is bullshit - what we want to do is force the use of A law for testing - lots of bandwidth but only small CPU load
 		pjmedia_codec_info* inf;
@@ -1073,30 +1567,162 @@ int main(int argc, char** argv)
 		//and then use the name to look up the info again and set priority
 		pjmedia_codec_mgr_set_codec_priority(codec_mgr,&(inf->encoding_name), PJMEDIA_CODEC_PRIO_HIGHEST);
 
-		for (int i=0; i<150; i++)
-		{
+		place_call = [&uri_to_call_string, &called_number, &calling_number](uint32_t hold_ms)
+				{
+			//the generator thread is not a pjlib thread - register it the first time through
+			static __thread pj_thread_desc thread_desc;
+			if (!pj_thread_is_registered())
+			{
+				pj_thread_t* thread;
+				pj_thread_register("callgen", thread_desc, &thread);
+			}
+
+			static uint64_t call_seq = 0; //only the generator thread places calls
+
+			unsigned connection = ConnectionPool::Pick(call_seq);
+
+			//encode an IAM carrying this call's numbers - everything lives on the stack until make_call has copied it
+			uint8_t iam_buf[256];
+			char called[32];
+			char calling[32];
+			IsupIam iam = IsupBodyCache::AxeIam();
+			iam.called.digits = called;
+			iam.called.len = IsupEncoder::ExpandNumber(called_number.c_str(), call_seq, called, sizeof(called));
+			iam.calling.digits = calling;
+			iam.calling.len = IsupEncoder::ExpandNumber(calling_number.c_str(), call_seq, calling, sizeof(calling));
+			call_seq++;
+
+			size_t iam_len = IsupEncoder::EncodeIAM(iam, iam_buf, sizeof(iam_buf));
+			if (iam_len == 0)
+				return false;
 
 			pjsua_msg_data msg_data;
+			pjsip_multipart_part iam_part;
+			pjsip_msg_body iam_body;
 
-			LocalCallUserData* callUserData = new LocalCallUserData;
-			add_SIP_I_AXE_IAM_Mime(callUserData->pool,&msg_data);
+			IsupBodyCache::AttachEncoded(iam_buf,iam_len,&iam_body,&iam_part,&msg_data);
 			pj_str_t uri = pj_str((char *)uri_to_call_string.c_str());
-			callUserData->callType=eCallType::SIMULATED_AXE_CALL_OFFER;
-			callUserData->call_id=-1; //we have to force the callid to soething AS WE ARE MAKING THE CALL - otherwise optional will barf
-			//I have no idea when the C interface populates the call_id - but it is prior to return, so we need
-			//the optional block to be allocated if not actually populated...
-			pjsua_call_make_call(acc_id, &uri, 0, callUserData, &msg_data, &(*(callUserData->call_id)));
-			callUserData->SetHangupTimer(300);
-			usleep(500000);
+
+			//the call context is claimed in on_call_sdp_created once pjsua has picked the call id
+			OutgoingCallRequest request = { eCallType::SIMULATED_AXE_CALL_OFFER, eSimulatorDirectionType::SIMULATED_UNI_DIRECTIONAL, hold_ms, connection };
+			pjsua_call_id call_id;
+
+			if (pjsua_call_make_call(ConnectionPool::Account(connection), &uri, 0, &request, &msg_data, &call_id) != PJ_SUCCESS)
+				return false;
+
+			//media set up can be deferred (ICE, STUN) so the SDP and with it the context may not exist yet - the request
+			//is about to go out of scope so claim the context now
+			if (!LocalCallUserData::LookupByCall(call_id))
+			{
+				LocalCallUserData* callUserData = CallContextSlab::Acquire(call_id);
+				if (callUserData)
+				{
+					callUserData->callType=request.callType;
+					callUserData->simDir=request.simDir;
+					callUserData->connection=request.connection;
+					callUserData->BindToCall(call_id);
+					callUserData->SetHangupTimer(hold_ms);
+				}
+			}
+			return true;
+				};
+		active_calls = [](void)
+				{
+			return (uint32_t)pjsua_call_get_count();
+				};
+
+		//the generator runs its own scheduling thread - so the main thread is free to service the console straight away.
+		//A search runs generators of its own, one rate at a time
+		if (!search)
+		{
+			generator.reset(new CallGenerator(gen_cfg, place_call, active_calls));
+			generator->Start();
+			printf("Generating %s arrivals over %s with seed %lu\n", gen_cfg.arrival._to_string(), call_transport._to_string(), generator->Seed());
 		}
 	}
 
-	/* Wait until user press "q" to quit. */
+	std::unique_ptr<MetricsExporter> metrics;
+	if (metrics_port)
+	{
+		metrics.reset(new MetricsExporter(metrics_port, std::chrono::milliseconds(metrics_interval_ms),
+				[](void)
+				{
+			return (uint32_t)ctr.load(std::memory_order_relaxed);
+				},
+				generator.get()));
+		metrics->Start();
+		printf("Serving metrics on http://127.0.0.1:%u/metrics\n", metrics_port);
+	}
 
-	for (;;) {
+	if (supervisor)
+	{
+		//the supervisor has the console - we publish what we are up to and do as we are told
+		supervisor->StartPublishing(worker,
+				[](void)
+				{
+			return (uint32_t)ctr.load(std::memory_order_relaxed);
+				},
+				generator.get(), std::chrono::milliseconds(500));
+
+		bool hangup, stop_generating;
+		while (ShardSupervisor::WaitForSupervisor(hangup, stop_generating))
+		{
+			if (hangup)
+				pjsua_call_hangup_all();
+			if (stop_generating && generator)
+				generator->Stop();
+		}
+
+		supervisor->StopPublishing();
+	}
+
+	if (bench_uas)
+	{
+		bench->Serve([](void)
+				{
+			return answered.load(std::memory_order_relaxed);
+				});
+	}
+	else if (search)
+	{
+		CpsSearch cps_search(search_cfg, gen_cfg, place_call, active_calls,
+				[](void)
+				{
+			return answered.load(std::memory_order_relaxed);
+				});
+
+		printf("Searching for the highest CPS against %s, %us a step\n", uri_to_call_string.c_str(), search_window_sec);
+		cps_search.Run();
+		pjsua_call_hangup_all();
+		cps_search.Print();
+	}
+	else if (bench)
+	{
+		BenchResult result;
+		printf("Benchmarking for %us against the UAS at %s\n", bench_sec, uri_to_call_string.c_str());
+		bench->Run(std::chrono::seconds(bench_sec), *generator,
+				[](void)
+				{
+			return (uint32_t)ctr.load(std::memory_order_relaxed);
+				},
+				[](void)
+				{
+			return answered.load(std::memory_order_relaxed);
+				},
+				result);
+
+		LoopbackBench::PrintResult(result);
+		print_latency();
+		print_cleared_calls();
+	}
+
+	/* Wait until user press "q" to quit - unless we are a worker, when the supervisor has the console, or
+	 * benchmarking or searching, when nobody does */
+
+	while (!supervisor && !bench && !search) {
 		char option[10];
 
-		puts("Press 'h' to hangup all calls, 'q' to quit");
+		puts("Press 'h' to hangup all calls, 'g' to stop generating calls, 'q' to quit");
 		if (fgets(option, sizeof(option), stdin) == NULL) {
 			puts("EOF while reading stdin, will quit now..");
 			break;
@@ -1105,109 +1731,128 @@ int main(int argc, char** argv)
 		if (option[0] == 'q')
 			break;
 
+		if (option[0] == 'g' && generator)
+			generator->Stop();
+
 		if (option[0] == 'h')
 			pjsua_call_hangup_all();
 
 		if(option[0] == 's')
 		{
 			printf("Current active calls %d\n",int(ctr));
-			printf("Calls cleared with reason:\n");
-			for(size_t i=0; i<statuscode_counter.size(); i++)
+			if (generator)
 			{
-				if (statuscode_counter[i] > 0 && pjsip_get_status_text2(i)!=0)
-				{
-					printf("%s %ld\n",pjsip_get_status_text2(i)->ptr,statuscode_counter[i]);
-				}
+				printf("Generator %s: attempts %lu failed %lu suppressed %lu late %lu\n",
+						generator->Running() ? "running" : "finished",
+						generator->Attempts(),
+						generator->Failed(),
+						generator->Suppressed(),
+						generator->Late());
+			}
+			RtpSnapshot rtp;
+			RtpStats::TakeTotal(rtp);
+			printf("RTP rx pkts %lu bytes %lu rtcp %lu, tx pkts %lu bytes %lu rtcp %lu, send errors %lu\n",
+					rtp.rx_packets, rtp.rx_bytes, rtp.rx_rtcp_packets,
+					rtp.tx_packets, rtp.tx_bytes, rtp.tx_rtcp_packets, rtp.tx_errors);
+			printf("RTP inter arrival (us) p50 <%lu p90 <%lu p99 <%lu p99.9 <%lu\n",
+					rtp.InterarrivalPercentile(0.5),
+					rtp.InterarrivalPercentile(0.9),
+					rtp.InterarrivalPercentile(0.99),
+					rtp.InterarrivalPercentile(0.999));
+			if (!pcap.prefix.empty())
+				printf("Captured packets %lu, dropped %lu\n", PacketCapture::Captured(), PacketCapture::Dropped());
+			if (RtpShards::Running())
+				printf("RTP from unknown addresses %lu\n", RtpShards::Strays());
+			if (DirectMedia::Running())
+			{
+				uint64_t sent, received, empty;
+				DirectMedia::Take(sent, received, empty);
+				printf("Direct media frames sent %lu, received %lu (%lu without audio)\n", sent, received, empty);
 			}
+
+			print_latency();
+
+			if (generator)
+				ConnectionPool::Print();
+
+			print_cleared_calls();
 		}
 
 		if (option[0] == 'l')
 		{
-			auto call_count = pjsua_call_get_count()+10; //reserve a little extra space, can 10 calls turn up in the meantime....
-			if (call_count>0)
+			//a copy of the registry - nothing here takes a pjsua lock, however many calls there are
+			std::vector<CallRecord> records;
+			char sdp_text[4096];
+			records.reserve(CallContextSlab::Capacity());
+			CallRegistry::Snapshot(records);
+
+			uint64_t now_us = CallLatency::Now();
+			for (auto& record: records)
 			{
-				std::vector<pjsua_call_id> calls(call_count);
-				pjsua_enum_calls(calls.data(),&call_count); //may update call count on another thread - we send in the max size and get back the real number
-				calls.resize(call_count);
-				for (auto call: calls)
+				uint64_t total_ms = (now_us - record.start_us) / 1000;
+				uint64_t connect_ms = record.connect_us ? (now_us - record.connect_us) / 1000 : 0;
+
+				printf("ID: %d\nLocal URI: %s Remote URI: %s\nCallID: %s\nState: %s\nConnect Duration: %lu.%03lus Total Duration %lu.%03lus\n",
+						record.call_id,
+						record.local_uri,
+						record.remote_uri,
+						record.sip_call_id,
+						pjsip_inv_state_name(record.state),
+						connect_ms / 1000,
+						connect_ms % 1000,
+						total_ms / 1000,
+						total_ms % 1000);
+
+				if (record.called_number[0])
+					printf("Called number: %s\n",record.called_number);
+
+				//only now is the SDP turned into text
+				LocalCallUserData* callUserData = LocalCallUserData::LookupByCall(record.call_id);
+				if (callUserData && callUserData->RenderSDP(sdp_text, sizeof(sdp_text)))
 				{
-					pjsua_call_info info;
-					if(pjsua_call_get_info(call,&info) == PJ_SUCCESS) //get info on the call - but it may disappear while iterating - so not finding it is not an error
-					{
-
-						printf("ID: %d\nLocal URI: %.*s Remote URI: %.*s\nCallID: %.*s\nState: %.*s\nConnect Duration: %ld.%03lds Total Duration %ld.%03lds\n",
-								call,
-								(int)info.local_info.slen,
-								info.local_info.ptr,
-								(int)info.remote_info.slen,
-								info.remote_info.ptr,
-								(int)info.call_id.slen,
-								info.call_id.ptr,
-								(int)info.state_text.slen,
-								info.state_text.ptr,
-								info.connect_duration.sec,
-								info.connect_duration.msec,
-								info.total_duration.sec,
-								info.total_duration.msec);
-
-						printf("SDP: \n");
-						printf(LocalCallUserData::LookupByCall(call)->sdp_buf.data());
-
-						PJSUA_LOCK();
-
-						pjsua_call* pcall = &pjsua_var.calls[call];
-
-						if (pcall) //was it still there??
-						{
-
-
-							pjsua_call_media* call_med = &pcall->media[0];  //this breaks when there are multiple media types...
-							pjmedia_rtcp_stat rtcp_stats;
-							pjmedia_stream_get_stat(call_med->strm.a.stream,&rtcp_stats);
-							PJSUA_UNLOCK();
-
-							if (vm.count("server")>0)
-							{
-								printf ("RX stats\npkts: %d bytes: %d\ndiscarded: %d lost: %d\nreordered: %d dup: %d\njitter (us) min/mean/max %d/%d/%d\n",
-										rtcp_stats.rx.pkt,
-										rtcp_stats.rx.bytes,
-										rtcp_stats.rx.discard,
-										rtcp_stats.rx.loss,
-										rtcp_stats.rx.reorder,
-										rtcp_stats.rx.dup,
-										rtcp_stats.rx.jitter.min,
-										rtcp_stats.rx.jitter.mean,
-										rtcp_stats.rx.jitter.max);
-							}
-							else
-							{
-								printf ("TX stats\npkts: %d bytes: %d\ndiscarded: %d lost: %d\nreordered: %d dup: %d\njitter (us) min/mean/max %d/%d/%d\n",
-										rtcp_stats.tx.pkt,
-										rtcp_stats.tx.bytes,
-										rtcp_stats.tx.discard,
-										rtcp_stats.tx.loss,
-										rtcp_stats.tx.reorder,
-										rtcp_stats.tx.dup,
-										rtcp_stats.tx.jitter.min,
-										rtcp_stats.tx.jitter.mean,
-										rtcp_stats.tx.jitter.max);
-							}
-
-						}
-						else
-						{
-							PJSUA_UNLOCK();
-						}
-
-
+					printf("SDP: \n");
+					printf("%s",sdp_text);
+				}
 
+				//the adapter counters stand in for pjmedia_stream_get_stat - which needs the call locked
+				RtpSnapshot rtp;
+				if (RtpStats::TakeCall(record.call_id,rtp))
+				{
+					if (server)
+					{
+						printf ("RX stats\npkts: %lu bytes: %lu rtcp: %lu\ninter arrival (us) p50/p99/p99.9 <%lu/<%lu/<%lu\n",
+								rtp.rx_packets,
+								rtp.rx_bytes,
+								rtp.rx_rtcp_packets,
+								rtp.InterarrivalPercentile(0.5),
+								rtp.InterarrivalPercentile(0.99),
+								rtp.InterarrivalPercentile(0.999));
+					}
+					else
+					{
+						printf ("TX stats\npkts: %lu bytes: %lu rtcp: %lu send errors: %lu\n",
+								rtp.tx_packets,
+								rtp.tx_bytes,
+								rtp.tx_rtcp_packets,
+								rtp.tx_errors);
 					}
-
 				}
 			}
 		}
 	}
 
+	if (metrics)
+		metrics->Stop();
+
+	if (generator)
+		generator->Stop();
+
+	CallContextSlab::StopTimers();
+	DirectMedia::Stop();
+	RtpPacer::Stop();
+	RtpShards::Stop();
+	PacketCapture::Stop();
+
 	return 0;
 }
 
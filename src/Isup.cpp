@@ -0,0 +1,386 @@
+#include "Isup.h"
+
+#include <cstring>
+
+namespace {
+
+//bounds checked cursor over the caller's buffer - once it overflows every write is dropped and Length() returns 0
+class IsupWriter {
+public:
+	IsupWriter(uint8_t* _buf, size_t _len):buf(_buf),len(_len),pos(0),overflow(false) {}
+
+	void Put(uint8_t b)
+	{
+		if (pos < len)
+			buf[pos++] = b;
+		else
+			overflow = true;
+	}
+
+	void Put(const uint8_t* data, size_t n)
+	{
+		//ANM and RLC have no variable part, and hand us NULL for it - memcpy may not be given that, even for nothing
+		if (n == 0)
+			return;
+
+		if (n > len - pos)
+		{
+			overflow = true;
+			return;
+		}
+		memcpy(buf + pos, data, n);
+		pos += n;
+	}
+
+	//leave room for a pointer or length octet that is filled in later
+	size_t Reserve()
+	{
+		size_t at = pos;
+		Put(0);
+		return at;
+	}
+
+	//Q.763 pointers count from the pointer octet itself to the first octet they point at
+	void PointHere(size_t ptr)
+	{
+		if (!overflow)
+			buf[ptr] = (uint8_t)(pos - ptr);
+	}
+
+	void LengthFrom(size_t lenAt)
+	{
+		if (!overflow)
+			buf[lenAt] = (uint8_t)(pos - lenAt - 1);
+	}
+
+	size_t Pos() const { return pos; }
+	size_t Length() const { return overflow ? 0 : pos; }
+
+private:
+	uint8_t* buf;
+	size_t len;
+	size_t pos;
+	bool overflow;
+};
+
+uint8_t DigitCode(char c)
+{
+	switch (c)
+	{
+	case '*': return 0x0B; //code 11
+	case '#': return 0x0C; //code 12
+	default:  return (uint8_t)(c - '0') & 0x0F;
+	}
+}
+
+//address signals are packed two per octet, first digit in the low nibble
+void PutDigits(IsupWriter& w, const IsupNumber& num)
+{
+	size_t signals = num.len + (num.st ? 1 : 0);
+
+	for (size_t i=0; i<signals; i+=2)
+	{
+		uint8_t lo = i < num.len ? DigitCode(num.digits[i]) : 0x0F;
+		uint8_t hi = 0;
+		if (i + 1 < num.len)
+			hi = DigitCode(num.digits[i+1]);
+		else if (i + 1 == num.len && num.st)
+			hi = 0x0F;
+		w.Put((uint8_t)(hi << 4 | lo));
+	}
+}
+
+bool OddSignals(const IsupNumber& num)
+{
+	return (num.len + (num.st ? 1 : 0)) & 1;
+}
+
+void PutCalledNumber(IsupWriter& w, const IsupNumber& num)
+{
+	w.Put((uint8_t)((OddSignals(num) ? 0x80 : 0) | (num.nai & 0x7F)));
+	w.Put((uint8_t)((num.ind & 1) << 7 | (num.npi & 0x07) << 4));
+	PutDigits(w, num);
+}
+
+void PutCallingNumber(IsupWriter& w, const IsupNumber& num)
+{
+	w.Put((uint8_t)((OddSignals(num) ? 0x80 : 0) | (num.nai & 0x7F)));
+	w.Put((uint8_t)((num.ind & 1) << 7 | (num.npi & 0x07) << 4 | (num.apri & 0x03) << 2 | (num.si & 0x03)));
+	PutDigits(w, num);
+}
+
+//messages whose only variable content is the optional part pointer - and we never send optional parameters on them
+size_t EncodeFixedOnly(uint8_t type, const uint8_t* fixed, size_t fixedLen, uint8_t* buf, size_t len)
+{
+	IsupWriter w(buf, len);
+
+	w.Put(type);
+	w.Put(fixed, fixedLen);
+	w.Put(0); //no optional part
+	return w.Length();
+}
+
+//Q.763 layout of the messages we can take apart
+struct MessageLayout
+{
+	uint8_t type;
+	uint8_t fixed_len;
+	uint8_t variable_cnt;
+};
+
+const MessageLayout layouts[] = {
+		{ eIsupMessageType::IAM, 5, 1 },
+		{ eIsupMessageType::ACM, 2, 0 },
+		{ eIsupMessageType::CON, 2, 0 },
+		{ eIsupMessageType::ANM, 0, 0 },
+		{ eIsupMessageType::REL, 0, 1 },
+		{ eIsupMessageType::RLC, 0, 0 },
+		{ eIsupMessageType::CPG, 1, 0 },
+};
+
+}
+
+
+size_t IsupEncoder::EncodeIAM(const IsupIam& iam, uint8_t* buf, size_t len)
+{
+	IsupWriter w(buf, len);
+
+	w.Put(eIsupMessageType::IAM);
+
+	//mandatory fixed part
+	w.Put(iam.nature_of_connection);
+	w.Put((uint8_t)(iam.forward_call >> 8));
+	w.Put((uint8_t)(iam.forward_call & 0xFF));
+	w.Put(iam.calling_category);
+	w.Put(iam.transmission_medium);
+
+	//mandatory variable part - just the called party number
+	size_t calledPtr = w.Reserve();
+	size_t optionalPtr = w.Reserve();
+
+	w.PointHere(calledPtr);
+	size_t lenAt = w.Reserve();
+	PutCalledNumber(w, iam.called);
+	w.LengthFrom(lenAt);
+
+	//optional part
+	bool optional = iam.calling.digits || iam.access_transport_len;
+	if (optional)
+	{
+		w.PointHere(optionalPtr);
+
+		if (iam.calling.digits)
+		{
+			w.Put(IsupParam::CALLING_PARTY_NUMBER);
+			lenAt = w.Reserve();
+			PutCallingNumber(w, iam.calling);
+			w.LengthFrom(lenAt);
+		}
+
+		if (iam.access_transport_len)
+		{
+			w.Put(IsupParam::ACCESS_TRANSPORT);
+			w.Put((uint8_t)iam.access_transport_len);
+			w.Put(iam.access_transport, iam.access_transport_len);
+		}
+
+		w.Put(IsupParam::END_OF_OPTIONAL);
+	}
+
+	return w.Length();
+}
+
+size_t IsupEncoder::EncodeACM(uint16_t backward_call, uint8_t* buf, size_t len)
+{
+	const uint8_t fixed[] = { (uint8_t)(backward_call >> 8), (uint8_t)(backward_call & 0xFF) };
+	return EncodeFixedOnly(eIsupMessageType::ACM, fixed, sizeof(fixed), buf, len);
+}
+
+size_t IsupEncoder::EncodeCPG(uint8_t event, uint8_t* buf, size_t len)
+{
+	return EncodeFixedOnly(eIsupMessageType::CPG, &event, 1, buf, len);
+}
+
+size_t IsupEncoder::EncodeANM(uint8_t* buf, size_t len)
+{
+	return EncodeFixedOnly(eIsupMessageType::ANM, NULL, 0, buf, len);
+}
+
+size_t IsupEncoder::EncodeCON(uint16_t backward_call, uint8_t* buf, size_t len)
+{
+	const uint8_t fixed[] = { (uint8_t)(backward_call >> 8), (uint8_t)(backward_call & 0xFF) };
+	return EncodeFixedOnly(eIsupMessageType::CON, fixed, sizeof(fixed), buf, len);
+}
+
+size_t IsupEncoder::EncodeREL(uint8_t cause, uint8_t location, uint8_t* buf, size_t len)
+{
+	IsupWriter w(buf, len);
+
+	w.Put(eIsupMessageType::REL);
+
+	size_t causePtr = w.Reserve();
+	w.Put(0); //no optional part
+
+	//cause indicators - ITU-T coding standard, extension bits set as there is no diagnostic
+	w.PointHere(causePtr);
+	w.Put(2);
+	w.Put((uint8_t)(0x80 | (location & 0x0F)));
+	w.Put((uint8_t)(0x80 | (cause & 0x7F)));
+
+	return w.Length();
+}
+
+size_t IsupEncoder::EncodeRLC(uint8_t* buf, size_t len)
+{
+	return EncodeFixedOnly(eIsupMessageType::RLC, NULL, 0, buf, len);
+}
+
+size_t IsupEncoder::ExpandNumber(const char* pattern, uint64_t seq, char* out, size_t len)
+{
+	size_t n = strlen(pattern);
+	if (n > len)
+		return 0;
+
+	//fill from the right so the sequence number lines up with the last x
+	for (size_t i=n; i-- > 0;)
+	{
+		if (pattern[i] == 'x' || pattern[i] == 'X')
+		{
+			out[i] = (char)('0' + seq % 10);
+			seq /= 10;
+		}
+		else
+		{
+			out[i] = pattern[i];
+		}
+	}
+	return n;
+}
+
+size_t IsupNumberView::Digits(char* out, size_t len) const
+{
+	static const char codes[] = "0123456789??*#??";
+	size_t n = 0;
+
+	for (size_t i=0; i<signals && n<len; i++)
+	{
+		uint8_t code = (i & 1) ? bcd[i/2] >> 4 : bcd[i/2] & 0x0F;
+		if (code == 0x0F) //ST
+			break;
+		out[n++] = codes[code];
+	}
+	return n;
+}
+
+bool IsupView::FindOptional(uint8_t code, IsupParamView& param) const
+{
+	size_t pos = 0;
+
+	//Decode has already checked every length in here
+	while (optional && pos < optional_len && optional[pos] != IsupParam::END_OF_OPTIONAL)
+	{
+		if (optional[pos] == code)
+		{
+			param.code = code;
+			param.len = optional[pos+1];
+			param.data = optional + pos + 2;
+			return true;
+		}
+		pos += 2 + optional[pos+1];
+	}
+	return false;
+}
+
+bool IsupDecoder::DecodeNumber(const IsupParamView& param, bool calling, IsupNumberView& number)
+{
+	if (param.len < 2)
+		return false;
+
+	number.present = true;
+	number.nai = param.data[0] & 0x7F;
+	number.ind = param.data[1] >> 7;
+	number.npi = (param.data[1] >> 4) & 0x07;
+	number.apri = calling ? (param.data[1] >> 2) & 0x03 : 0;
+	number.si = calling ? param.data[1] & 0x03 : 0;
+	number.bcd = param.data + 2;
+	number.signals = (param.len - 2) * 2;
+	if (number.signals && (param.data[0] & 0x80)) //odd - the last high nibble is filler
+		number.signals--;
+	return true;
+}
+
+bool IsupDecoder::Decode(const uint8_t* data, size_t len, IsupView& view)
+{
+	const MessageLayout* layout = NULL;
+
+	memset(&view, 0, sizeof(view));
+	if (!data || len < 1)
+		return false;
+
+	view.type = data[0];
+	for (auto& l : layouts)
+	{
+		if (l.type == view.type)
+			layout = &l;
+	}
+	if (!layout)
+		return false;
+
+	size_t pos = 1;
+	if (len - pos < layout->fixed_len)
+		return false;
+	view.fixed = data + pos;
+	view.fixed_len = layout->fixed_len;
+	pos += layout->fixed_len;
+
+	//pointers to the mandatory variable parameters, then the pointer to the optional part
+	if (len - pos < layout->variable_cnt)
+		return false;
+	for (unsigned i=0; i<layout->variable_cnt; i++, pos++)
+	{
+		size_t at = pos + data[pos];
+		if (data[pos] == 0 || at >= len || data[at] > len - at - 1)
+			return false;
+		view.variable[i].code = 0;
+		view.variable[i].len = data[at];
+		view.variable[i].data = data + at + 1;
+	}
+	view.variable_cnt = layout->variable_cnt;
+
+	//some switches leave the optional part pointer off altogether when there is nothing in it
+	if (pos < len && data[pos] != 0)
+	{
+		size_t at = pos + data[pos];
+		if (at >= len)
+			return false;
+
+		//make sure every optional parameter fits before anyone walks them - running out of bytes on a parameter
+		//boundary is taken as a missing end of optional parameters octet rather than an error
+		size_t opt = at;
+		while (opt < len && data[opt] != IsupParam::END_OF_OPTIONAL)
+		{
+			if (len - opt < 2 || data[opt+1] > len - opt - 2)
+				return false;
+			opt += 2 + data[opt+1];
+		}
+		view.optional = data + at;
+		view.optional_len = opt - at;
+	}
+
+	if (view.type == eIsupMessageType::IAM)
+	{
+		IsupParamView param = view.variable[0];
+		param.code = IsupParam::CALLED_PARTY_NUMBER;
+		if (!DecodeNumber(param, false, view.called))
+			return false;
+
+		if (view.FindOptional(IsupParam::CALLING_PARTY_NUMBER, param))
+			DecodeNumber(param, true, view.calling);
+	}
+	else if (view.type == eIsupMessageType::REL)
+	{
+		view.variable[0].code = IsupParam::CAUSE_INDICATORS;
+	}
+
+	return true;
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "Enum.h"
+
+//ISUP (Q.763) message types we know how to build
+ENUM(eIsupMessageType, uint8_t, IAM=0x01, ACM=0x06, CON=0x07, ANM=0x09, REL=0x0C, RLC=0x10, CPG=0x2C);
+
+//Q.763 parameter names - only the ones we encode or look for
+namespace IsupParam
+{
+	enum : uint8_t
+	{
+		END_OF_OPTIONAL              = 0x00,
+		TRANSMISSION_MEDIUM          = 0x02,
+		ACCESS_TRANSPORT             = 0x03,
+		CALLED_PARTY_NUMBER          = 0x04,
+		NATURE_OF_CONNECTION         = 0x06,
+		FORWARD_CALL_INDICATORS      = 0x07,
+		CALLING_PARTY_CATEGORY       = 0x09,
+		CALLING_PARTY_NUMBER         = 0x0A,
+		REDIRECTING_NUMBER           = 0x0B,
+		BACKWARD_CALL_INDICATORS     = 0x11,
+		CAUSE_INDICATORS             = 0x12,
+		USER_SERVICE_INFORMATION     = 0x1D,
+		EVENT_INFORMATION            = 0x24,
+		ORIGINAL_CALLED_NUMBER       = 0x28,
+		OPTIONAL_BACKWARD_CALL_IND   = 0x29,
+	};
+}
+
+//a called or calling party number - digits are ASCII and need not be NUL terminated
+struct IsupNumber
+{
+	const char* digits;  //NULL leaves an optional number out of the message
+	size_t      len;
+	uint8_t     nai;     //nature of address indicator
+	uint8_t     npi;     //numbering plan indicator
+	uint8_t     ind;     //INN indicator for a called number, NI indicator for a calling number
+	uint8_t     apri;    //calling number only - address presentation restricted indicator
+	uint8_t     si;      //calling number only - screening indicator
+	bool        st;      //called number only - finish with the ST (end of pulsing) signal
+};
+
+struct IsupIam
+{
+	uint8_t  nature_of_connection;
+	uint16_t forward_call;        //first octet in the high byte - the way wireshark shows it
+	uint8_t  calling_category;
+	uint8_t  transmission_medium;
+	IsupNumber called;
+	IsupNumber calling;           //optional
+	const uint8_t* access_transport; //optional - the Q.931 information elements are passed through untouched
+	size_t   access_transport_len;
+};
+
+//builds ISUP messages into a caller supplied buffer - nothing here allocates, so it is safe to call per call on the
+//signalling threads. Every Encode function returns the encoded length, or 0 if the buffer was too small
+class IsupEncoder {
+public:
+	static size_t EncodeIAM(const IsupIam& iam, uint8_t* buf, size_t len);
+	static size_t EncodeACM(uint16_t backward_call, uint8_t* buf, size_t len);
+	static size_t EncodeCPG(uint8_t event, uint8_t* buf, size_t len);
+	static size_t EncodeANM(uint8_t* buf, size_t len);
+	static size_t EncodeCON(uint16_t backward_call, uint8_t* buf, size_t len);
+	static size_t EncodeREL(uint8_t cause, uint8_t location, uint8_t* buf, size_t len);
+	static size_t EncodeRLC(uint8_t* buf, size_t len);
+
+	//replace the x's in pattern with the low digits of seq, so "0396xxxxxx" and seq 42 gives "0396000042".
+	//Returns the number of digits written to out (not NUL terminated) or 0 if out is too small
+	static size_t ExpandNumber(const char* pattern, uint64_t seq, char* out, size_t len);
+};
+
+//one parameter of a received message - data points into the message body
+struct IsupParamView
+{
+	uint8_t        code;
+	uint8_t        len;
+	const uint8_t* data;
+};
+
+//a party number as it sits in the message - the digits stay packed until someone asks for them
+struct IsupNumberView
+{
+	bool           present;
+	uint8_t        nai;
+	uint8_t        npi;
+	uint8_t        ind;     //INN indicator (called) or NI indicator (calling)
+	uint8_t        apri;    //calling only
+	uint8_t        si;      //calling only
+	const uint8_t* bcd;
+	size_t         signals; //number of address signals, including the ST signal if there is one
+
+	//unpack the address signals as ASCII, stopping at ST. Returns the number of digits written (not NUL terminated)
+	size_t Digits(char* out, size_t len) const;
+};
+
+//a received ISUP message. Nothing is copied - the view is only valid while the buffer it was decoded from is
+struct IsupView
+{
+	uint8_t        type;
+	const uint8_t* fixed;          //mandatory fixed part
+	size_t         fixed_len;
+	IsupParamView  variable[2];    //mandatory variable part, in message order
+	unsigned       variable_cnt;
+	const uint8_t* optional;       //optional part, NULL if there is none
+	size_t         optional_len;
+
+	IsupNumberView called;         //IAM only
+	IsupNumberView calling;        //IAM only - from the optional part
+
+	//walk the optional part for the first parameter with this code
+	bool FindOptional(uint8_t code, IsupParamView& param) const;
+};
+
+class IsupDecoder {
+public:
+	//check every pointer and length against len and fill in view - returns false if the message is truncated,
+	//inconsistent or of a type we do not know the layout of
+	static bool Decode(const uint8_t* data, size_t len, IsupView& view);
+
+	static bool DecodeNumber(const IsupParamView& param, bool calling, IsupNumberView& number);
+};
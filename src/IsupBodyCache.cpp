@@ -0,0 +1,270 @@
+#include "IsupBodyCache.h"
+
+#include <chrono>
+#include <cstdio>
+
+#define THIS_FILE "ISUP_CACHE"
+
+namespace {
+
+const char* content_type_string = "application";
+const char* content_subtype_string = "ISUP; version=itu-t92+ \nContent-Disposition: signal; handling=required";
+
+/*this is an IAM string extracted from PCAP trace
+ISDN User Part
+    Message Type: Initial address (1)
+    Nature of Connection Indicators : 0x0
+        Mandatory Parameter: Nature of connection indicators (6)
+        .... ..00 = Satellite Indicator: No Satellite circuit in connection (0x0)
+        .... 00.. = Continuity Check Indicator: Continuity check not required (0x0)
+        ...0 .... = Echo Control Device Indicator: Echo control device not included
+    Forward Call Indicators : 0x2001
+        Mandatory Parameter: Forward call indicators (7)
+        .... ...0 .... .... = National/international call indicator: Call to be treated as national call
+        .... .00. .... .... = End-to-end method indicator: No End-to-end method available (only link-by-link method available) (0x0)
+        .... 0... .... .... = Interworking indicator: no interworking encountered (No.7 signalling all the way)
+        ...0 .... .... .... = End-to-end information indicator: no end-to-end information available
+        ..1. .... .... .... = ISDN user part indicator: ISDN user part used all the way
+        00.. .... .... .... = ISDN user part preference indicator: ISDN user part preferred all the way (0x0)
+        .... .... .... ...1 = ISDN access indicator: originating access ISDN
+        .... .... .... .00. = SCCP method indicator: No indication (0x0)
+        .... .... ...0 .... = Ported number translation indicator: number not translated
+        .... .... ..0. .... = Query on Release attempt indicator: no QoR routing attempt in progress
+    Calling Party's category : 0xf7 (reserved/spare)
+        Mandatory Parameter: Calling party's category (9)
+        Calling Party's category: Unknown (0xf7)
+    Transmission medium requirement : 0 (speech)
+        Mandatory Parameter: Transmission medium requirement (2)
+        Transmission medium requirement: speech (0)
+    Called Party NumberCalled Party Number: 0396504232F
+        Mandatory Parameter: Called party number (4)
+        Pointer to Parameter: 2
+        Parameter Length: 8
+        1... .... = Odd/even indicator: odd number of address signals
+        .000 0010 = Nature of address indicator: unknown (national use) (2)
+        1... .... = INN indicator: routing to internal network number not allowed
+        .001 .... = Numbering plan indicator: ISDN (Telephony) numbering plan (1)
+        Called Party Number: 0396504232F
+            .... 0000 = Address signal digit: 0 (0)
+            0011 .... = Address signal digit: 3 (3)
+            .... 1001 = Address signal digit: 9 (9)
+            0110 .... = Address signal digit: 6 (6)
+            .... 0101 = Address signal digit: 5 (5)
+            0000 .... = Address signal digit: 0 (0)
+            .... 0100 = Address signal digit: 4 (4)
+            0010 .... = Address signal digit: 2 (2)
+            .... 0011 = Address signal digit: 3 (3)
+            0010 .... = Address signal digit: 2 (2)
+            .... 1111 = Address signal digit: Stop sending (15)
+            E.164 Called party number digits: 0396504232F
+    Pointer to start of optional part: 10
+    Parameter: (t=10, l=7) Calling party number: Calling party numberCalling Party Number: 418702172
+        Optional Parameter: Calling party number (10)
+        Parameter Length: 7
+        1... .... = Odd/even indicator: odd number of address signals
+        .000 0011 = Nature of address indicator: national (significant) number (3)
+        0... .... = NI indicator: complete
+        .001 .... = Numbering plan indicator: ISDN (Telephony) numbering plan (1)
+        .... 00.. = Address presentation restricted indicator: presentation allowed (0)
+        .... ..11 = Screening indicator: network provided (3)
+        Calling Party Number: 418702172
+            .... 0100 = Address signal digit: 4 (4)
+            0001 .... = Address signal digit: 1 (1)
+            .... 1000 = Address signal digit: 8 (8)
+            0111 .... = Address signal digit: 7 (7)
+            .... 0000 = Address signal digit: 0 (0)
+            0010 .... = Address signal digit: 2 (2)
+            .... 0001 = Address signal digit: 1 (1)
+            0111 .... = Address signal digit: 7 (7)
+            .... 0010 = Address signal digit: 2 (2)
+            E.164 Calling party number digits: 418702172
+    Parameter: (t=3, l=37) Access transport: Access transport
+        Optional Parameter: Access transport (3)
+        Parameter Length: 37
+        Access transport parameter field (-> Q.931): 710ca01100f1400000f1400000f06d15a020003101001081...
+        Called party subaddress
+            Information element: Called party subaddress
+            Length: 12
+            .010 .... = Type of subaddress: Unknown (0x2)
+            .... 0... = Odd/even indicator: Even number of address signals (0x0)
+            Subaddress: 1100f1400000f1400000f0
+        Calling party subaddress
+            Information element: Calling party subaddress
+            Length: 21
+            .010 .... = Type of subaddress: Unknown (0x2)
+            .... 0... = Odd/even indicator: Even number of address signals (0x0)
+            Subaddress: 200031010010818080010001f2f1ff0080ffff11
+    End of optional parameters (0)
+ */
+const uint8_t axe_iam_content[] = {
+		0x01,0x00,0x20,0x01,0xf7,0x00,0x02,0x0a,
+		0x08,0x82,0x90,0x30,0x69,0x05,0x24,0x23,
+		0x0f,0x0a,0x07,0x83,0x13,0x14,0x78,0x20,
+		0x71,0x02,0x03,0x25,0x71,0x0c,0xa0,0x11,
+		0x00,0xf1,0x40,0x00,0x00,0xf1,0x40,0x00,
+		0x00,0xf0,0x6d,0x15,0xa0,0x20,0x00,0x31,
+		0x01,0x00,0x10,0x81,0x80,0x80,0x01,0x00,
+		0x01,0xf2,0xf1,0xff,0x00,0x80,0xff,0xff,
+		0x11,0x00
+};
+
+const char s12_iam_content[] = "THIS WAS AN S12 IAM A bunch of zeros \0\0\0\0 And after the zeros - ";
+
+//the same IAM as encoder input - the access transport parameter is passed through from the trace
+const IsupIam axe_iam = {
+		0x00,   //no satellite, no continuity check, no echo control device
+		0x2001, //ISUP all the way, originating access ISDN
+		0xf7,   //calling party's category
+		0x00,   //speech
+		{ "0396504232", 10, 2, 1, 1, 0, 0, true }, //unknown NAI, ISDN numbering plan, INN not allowed, ST
+		{ "418702172", 9, 3, 1, 0, 0, 3, false },  //national number, ISDN numbering plan, presentation allowed, network provided
+		axe_iam_content + 28, 37
+};
+
+//CON + BACKWARD CALL INDICATOR BYTES
+const uint16_t con_backward_call = 0x0616;
+
+pj_pool_t* cache_pool = NULL;
+pjsip_msg_body* bodies[eIsupBody::_size()];
+
+}
+
+
+pjsip_msg_body* IsupBodyCache::Build(pj_pool_t* pool, eIsupBody which)
+{
+	const pj_str_t content_type=pj_str((char*)content_type_string);
+	const pj_str_t content_subtype=pj_str((char*)content_subtype_string);
+	pj_str_t content;
+	uint8_t encoded[16];
+
+	//treat these as a bucket of bytes - NOT NULL TERMINATED STRINGS
+	switch (which)
+	{
+	case eIsupBody::AXE_IAM :
+		content={(char*)axe_iam_content,sizeof(axe_iam_content)}; //note NOT STRLEN!!!
+		break;
+	case eIsupBody::S12_IAM :
+		content={(char*)s12_iam_content,sizeof(s12_iam_content)};
+		break;
+	case eIsupBody::CON :
+		content={(char*)encoded,(pj_ssize_t)IsupEncoder::EncodeCON(con_backward_call,encoded,sizeof(encoded))};
+		break;
+	case eIsupBody::ANM :
+	default:
+		content={(char*)encoded,(pj_ssize_t)IsupEncoder::EncodeANM(encoded,sizeof(encoded))};
+		break;
+	}
+
+	return pjsip_msg_body_create(pool, &content_type, &content_subtype, &content);
+}
+
+void IsupBodyCache::Init()
+{
+	if (cache_pool)
+		return;
+
+	cache_pool = pjsua_pool_create("isup_cache", 1024, 1024);
+	for (auto which : eIsupBody::_values())
+	{
+		bodies[which._to_integral()] = Build(cache_pool, which);
+	}
+}
+
+const pjsip_msg_body* IsupBodyCache::Body(eIsupBody which)
+{
+	return bodies[which._to_integral()];
+}
+
+void IsupBodyCache::Attach(eIsupBody which, pjsip_multipart_part* part, pjsua_msg_data* msg_data)
+{
+	pj_list_init(part);
+	pj_list_init(&part->hdr);
+	part->body = bodies[which._to_integral()];
+
+	pjsua_msg_data_init(msg_data);
+
+	msg_data->multipart_ctype.type = pj_str((char*)"multipart");
+	msg_data->multipart_ctype.subtype = pj_str((char*)"mixed");
+	pj_list_push_back(&msg_data->multipart_parts, part);
+}
+
+void IsupBodyCache::AttachEncoded(const uint8_t* data, size_t len, pjsip_msg_body* body, pjsip_multipart_part* part,
+		pjsua_msg_data* msg_data)
+{
+	*body = *bodies[eIsupBody::AXE_IAM]; //content type and print/clone functions are the same for every ISUP body
+	body->data = (void*)data;
+	body->len = (unsigned)len;
+
+	pj_list_init(part);
+	pj_list_init(&part->hdr);
+	part->body = body;
+
+	pjsua_msg_data_init(msg_data);
+
+	msg_data->multipart_ctype.type = pj_str((char*)"multipart");
+	msg_data->multipart_ctype.subtype = pj_str((char*)"mixed");
+	pj_list_push_back(&msg_data->multipart_parts, part);
+}
+
+const IsupIam& IsupBodyCache::AxeIam()
+{
+	return axe_iam;
+}
+
+void IsupBodyCache::Benchmark(unsigned iterations)
+{
+	typedef std::chrono::steady_clock Clock;
+	pj_pool_t* pool = pjsua_pool_create("isup_bench", 512, 512);
+	pjsua_msg_data msg_data;
+	pjsip_multipart_part part;
+	uint64_t sink = 0; //stop the optimiser throwing the work away
+
+	Init();
+
+	//before - what every call used to do, a part and a body built into the call's pool
+	Clock::time_point start = Clock::now();
+	for (unsigned i=0; i<iterations; i++)
+	{
+		pjsip_multipart_part* alt_part = pjsip_multipart_create_part(pool);
+		alt_part->body = Build(pool, eIsupBody::AXE_IAM);
+
+		pjsua_msg_data_init(&msg_data);
+		msg_data.multipart_ctype.type = pj_str((char*)"multipart");
+		msg_data.multipart_ctype.subtype = pj_str((char*)"mixed");
+		pj_list_push_back(&msg_data.multipart_parts, alt_part);
+		sink += alt_part->body->len;
+
+		pj_pool_reset(pool);
+	}
+	double before = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+	//after - attach the shared body
+	start = Clock::now();
+	for (unsigned i=0; i<iterations; i++)
+	{
+		Attach(eIsupBody::AXE_IAM, &part, &msg_data);
+		sink += part.body->len;
+	}
+	double after = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+	//and an IAM encoded per call with its own numbers
+	uint8_t iam_buf[256];
+	char called[32];
+	pjsip_msg_body body;
+	IsupIam iam = axe_iam;
+	start = Clock::now();
+	for (unsigned i=0; i<iterations; i++)
+	{
+		iam.called.digits = called;
+		iam.called.len = IsupEncoder::ExpandNumber("0396xxxxxx", i, called, sizeof(called));
+		size_t len = IsupEncoder::EncodeIAM(iam, iam_buf, sizeof(iam_buf));
+		AttachEncoded(iam_buf, len, &body, &part, &msg_data);
+		sink += part.body->len;
+	}
+	double encoded = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / iterations;
+
+	pj_pool_release(pool);
+
+	printf("ISUP IAM body over %u calls: per call build %.1f ns, cached attach %.1f ns, encode and attach %.1f ns (%lu)\n",
+			iterations, before, after, encoded, sink);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include "Enum.h"
+#include "Isup.h"
+
+//the ISUP messages we attach to SIP-I requests and responses
+ENUM(eIsupBody, uint16_t, AXE_IAM, S12_IAM, CON, ANM);
+
+//every call used to rebuild the same content type strings, msg body and multipart part from constant bytes into
+//its own pool. The bodies never change so we build them once at startup and every call shares them - pjsua clones
+//the parts into the tdata pool when it builds the message, so the shared copies are never written to
+class IsupBodyCache {
+public:
+	//build every body - call once after pjsua_create() and before any call is made
+	static void Init();
+
+	static const pjsip_msg_body* Body(eIsupBody which);
+
+	//point msg_data at the cached body for which. part is caller supplied storage for the list node (normally on the
+	//stack) and only has to live until the pjsua call that consumes msg_data returns
+	static void Attach(eIsupBody which, pjsip_multipart_part* part, pjsua_msg_data* msg_data);
+
+	//same again for a body encoded per call. body is caller supplied storage too - it takes the cached content type
+	//and points at data, which pjsua copies into the tdata pool
+	static void AttachEncoded(const uint8_t* data, size_t len, pjsip_msg_body* body, pjsip_multipart_part* part,
+			pjsua_msg_data* msg_data);
+
+	//the IAM from the AXE trace as encoder input, so each call can swap in its own numbers
+	static const IsupIam& AxeIam();
+
+	//the old per call path - builds a fresh body in pool. Only kept so the benchmark has something to compare with
+	static pjsip_msg_body* Build(pj_pool_t* pool, eIsupBody which);
+
+	//time building per call against attaching from the cache and print the results
+	static void Benchmark(unsigned iterations);
+};
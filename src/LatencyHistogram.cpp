@@ -0,0 +1,127 @@
+#include "LatencyHistogram.h"
+
+#include <chrono>
+
+LatencyHistogram CallLatency::histograms[eLatencyMilestone::_size_constant];
+
+void LatencyHistogram::Snapshot::Clear()
+{
+	count = 0;
+	sum = 0;
+	max = 0;
+	for (unsigned i=0; i<BUCKETS; i++)
+		counts[i] = 0;
+}
+
+void LatencyHistogram::Snapshot::Merge(const Snapshot& other)
+{
+	count += other.count;
+	sum += other.sum;
+	if (other.max > max)
+		max = other.max;
+	for (unsigned i=0; i<BUCKETS; i++)
+		counts[i] += other.counts[i];
+}
+
+void LatencyHistogram::Snapshot::Subtract(const Snapshot& earlier)
+{
+	count -= earlier.count;
+	sum -= earlier.sum;
+	for (unsigned i=0; i<BUCKETS; i++)
+		counts[i] -= earlier.counts[i];
+}
+
+uint64_t LatencyHistogram::Snapshot::Percentile(double fraction) const
+{
+	uint64_t total = 0;
+
+	//sum the buckets rather than trust count - a sample may be half recorded while we read
+	for (unsigned i=0; i<BUCKETS; i++)
+		total += counts[i];
+	if (total == 0)
+		return 0;
+
+	uint64_t want = (uint64_t)(fraction * total);
+	uint64_t seen = 0;
+	for (unsigned i=0; i<BUCKETS; i++)
+	{
+		seen += counts[i];
+		if (seen > want)
+		{
+			uint64_t top = BucketTop(i);
+			return top < max ? top : max;
+		}
+	}
+	return max;
+}
+
+LatencyHistogram::LatencyHistogram():count(0),sum(0),max(0)
+{
+	for (unsigned i=0; i<BUCKETS; i++)
+		counts[i].store(0, std::memory_order_relaxed);
+}
+
+//below SUB_BUCKETS the value is its own bucket. Above that the top SUB_BITS bits pick a bucket within the power of 2
+//range the value falls in - the top bit is always set, so only HALF_BUCKETS of them are used per range
+unsigned LatencyHistogram::BucketOf(uint64_t usec)
+{
+	if (usec < SUB_BUCKETS)
+		return usec;
+
+	unsigned msb = 63 - __builtin_clzll(usec);
+	if (msb >= MAX_BITS)
+		return BUCKETS - 1;
+
+	unsigned shift = msb - (SUB_BITS - 1);
+	return SUB_BUCKETS + (shift - 1) * HALF_BUCKETS + ((usec >> shift) - HALF_BUCKETS);
+}
+
+uint64_t LatencyHistogram::BucketTop(unsigned bucket)
+{
+	if (bucket < SUB_BUCKETS)
+		return bucket;
+
+	unsigned shift = (bucket - SUB_BUCKETS) / HALF_BUCKETS + 1;
+	uint64_t top = (bucket - SUB_BUCKETS) % HALF_BUCKETS + HALF_BUCKETS;
+	return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t usec)
+{
+	counts[BucketOf(usec)].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(usec, std::memory_order_relaxed);
+
+	uint64_t seen = max.load(std::memory_order_relaxed);
+	while (usec > seen && !max.compare_exchange_weak(seen, usec, std::memory_order_relaxed))
+		;
+}
+
+void LatencyHistogram::MergeInto(Snapshot& snap) const
+{
+	snap.count += count.load(std::memory_order_relaxed);
+	snap.sum += sum.load(std::memory_order_relaxed);
+
+	uint64_t m = max.load(std::memory_order_relaxed);
+	if (m > snap.max)
+		snap.max = m;
+
+	for (unsigned i=0; i<BUCKETS; i++)
+		snap.counts[i] += counts[i].load(std::memory_order_relaxed);
+}
+
+void CallLatency::Record(eLatencyMilestone milestone, uint64_t usec)
+{
+	histograms[milestone._to_integral()].Record(usec);
+}
+
+void CallLatency::Take(eLatencyMilestone milestone, LatencyHistogram::Snapshot& snap)
+{
+	snap.Clear();
+	histograms[milestone._to_integral()].MergeInto(snap);
+}
+
+uint64_t CallLatency::Now()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
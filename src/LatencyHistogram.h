@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "Enum.h"
+
+//the signalling milestones we time on each call
+//INVITE_100  - INVITE sent to 100 Trying received
+//INVITE_18X  - INVITE sent to the first 180/183 received
+//INVITE_200  - INVITE sent to 200 OK received
+//ANSWER_ACK  - 200 OK sent or received to the call being CONFIRMED by the ACK
+//BYE_200     - BYE sent to its 200 OK received
+ENUM(eLatencyMilestone, uint16_t, INVITE_100, INVITE_18X, INVITE_200, ANSWER_ACK, BYE_200);
+
+//HDR style histogram of microsecond values - every power of 2 range is split into SUB_BUCKETS/2 linear buckets,
+//so any value is held to within ~3% whatever its size. Values below SUB_BUCKETS are exact
+class LatencyHistogram {
+public:
+	static const unsigned SUB_BITS = 6;
+	static const unsigned SUB_BUCKETS = 1 << SUB_BITS;
+	static const unsigned HALF_BUCKETS = SUB_BUCKETS / 2;
+	static const unsigned MAX_BITS = 40; //about 12 days in microseconds - anything longer is counted as that
+	static const unsigned BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BITS) * HALF_BUCKETS;
+
+	//plain copy of the counts - add as many as you like together
+	struct Snapshot
+	{
+		uint64_t count;
+		uint64_t sum;
+		uint64_t max;
+		uint64_t counts[BUCKETS];
+
+		void Clear();
+		void Merge(const Snapshot& other);
+
+		//leave only what was recorded since earlier was taken - max stays the all time max, there is no undoing it
+		void Subtract(const Snapshot& earlier);
+
+		//the value at or below which the given fraction of samples fall - the top of the bucket holding it, 0 if empty
+		uint64_t Percentile(double fraction) const;
+	};
+
+	LatencyHistogram();
+
+	//lock free - a relaxed increment of one bucket and the count
+	void Record(uint64_t usec);
+
+	//add our counts into snap
+	void MergeInto(Snapshot& snap) const;
+
+	static unsigned BucketOf(uint64_t usec);
+	static uint64_t BucketTop(unsigned bucket);
+
+private:
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+	std::atomic<uint64_t> counts[BUCKETS];
+};
+
+//one histogram per milestone for the whole process
+class CallLatency {
+public:
+	static void Record(eLatencyMilestone milestone, uint64_t usec);
+
+	static void Take(eLatencyMilestone milestone, LatencyHistogram::Snapshot& snap);
+
+	//monotonic microseconds - what the call context timestamps are taken with
+	static uint64_t Now();
+
+private:
+	static LatencyHistogram histograms[eLatencyMilestone::_size_constant];
+};
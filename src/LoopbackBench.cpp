@@ -0,0 +1,143 @@
+#include "LoopbackBench.h"
+#include "ShardSupervisor.h"
+
+#include <pjsua-lib/pjsua.h>
+
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <thread>
+
+LoopbackBench::LoopbackBench():shared(NULL),child(0)
+{
+	void* mem = mmap(NULL, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		std::cerr << "WTF - cannot map the benchmark results: " << strerror(errno) << std::endl;
+		exit(-1);
+	}
+
+	shared = new (mem) Shared();
+}
+
+LoopbackBench::~LoopbackBench()
+{
+	if (child > 0)
+	{
+		kill(child, SIGTERM);
+		waitpid(child, NULL, 0);
+	}
+	munmap(shared, sizeof(Shared));
+}
+
+bool LoopbackBench::Fork()
+{
+	pid_t pid = fork();
+	if (pid < 0)
+	{
+		perror("fork failed with");
+		exit(-1);
+	}
+
+	if (pid == 0)
+	{
+		//go when we do, and leave SIGTERM for Serve to wait on
+		prctl(PR_SET_PDEATHSIG, SIGTERM);
+		ShardSupervisor::BlockWorkerSignals();
+		return true;
+	}
+
+	child = pid;
+	return false;
+}
+
+void LoopbackBench::Serve(AnsweredFn answered)
+{
+	bool hangup, stop_generating;
+
+	//only SIGTERM means anything to us - the UAC hangs its calls up itself
+	while (ShardSupervisor::WaitForSupervisor(hangup, stop_generating))
+		;
+
+	shared->answered = answered();
+	RtpStats::TakeTotal(shared->rtp);
+	shared->done = true;
+}
+
+void LoopbackBench::Run(std::chrono::seconds duration, CallGenerator& generator, ActiveCallsFn active_calls,
+		AnsweredFn answered, BenchResult& result)
+{
+	auto start = std::chrono::steady_clock::now();
+	auto end = start + duration;
+
+	while (std::chrono::steady_clock::now() < end && generator.Running())
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+	generator.Stop();
+	result.elapsed_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	//what is still up is hung up and given a little while to clear, so the RTP counts on both sides settle
+	pjsua_call_hangup_all();
+	auto drain = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+	while (active_calls() && std::chrono::steady_clock::now() < drain)
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+	result.attempts = generator.Attempts();
+	result.failed = generator.Failed();
+	result.suppressed = generator.Suppressed();
+	result.answered = answered();
+	RtpStats::TakeTotal(result.uac);
+
+	//the child writes its figures before it exits - once it is reaped they are there to read
+	kill(child, SIGTERM);
+	waitpid(child, NULL, 0);
+	child = 0;
+
+	if (shared->done)
+	{
+		result.uas_answered = shared->answered;
+		result.uas = shared->rtp;
+	}
+	else
+	{
+		fprintf(stderr, "The UAS did not report back - its figures are missing\n");
+		result.uas_answered = 0;
+		memset(&result.uas, 0, sizeof(result.uas));
+	}
+}
+
+void LoopbackBench::PrintResult(const BenchResult& result)
+{
+	double elapsed = result.elapsed_sec > 0 ? result.elapsed_sec : 1;
+
+	printf("Benchmark ran %.1fs\n", result.elapsed_sec);
+	printf("Offered %lu calls (%.1f/s), %lu refused by the stack, %lu suppressed by --concurrency\n",
+			result.attempts, result.attempts / elapsed, result.failed, result.suppressed);
+	printf("Answered %lu (UAS answered %lu) - achieved %.1f CPS\n",
+			result.answered, result.uas_answered, result.answered / elapsed);
+
+	//each side's sent RTP is the other side's received - there is no one else on loopback
+	uint64_t lost_up = result.uac.tx_packets > result.uas.rx_packets ? result.uac.tx_packets - result.uas.rx_packets : 0;
+	uint64_t lost_down = result.uas.tx_packets > result.uac.rx_packets ? result.uas.tx_packets - result.uac.rx_packets : 0;
+
+	printf("RTP UAC->UAS sent %lu received %lu lost %lu (%.3f%%)\n",
+			result.uac.tx_packets, result.uas.rx_packets, lost_up,
+			result.uac.tx_packets ? 100.0 * lost_up / result.uac.tx_packets : 0.0);
+	if (result.uas.tx_packets)
+		printf("RTP UAS->UAC sent %lu received %lu lost %lu (%.3f%%)\n",
+				result.uas.tx_packets, result.uac.rx_packets, lost_down, 100.0 * lost_down / result.uas.tx_packets);
+	printf("RTP send errors UAC %lu UAS %lu\n", result.uac.tx_errors, result.uas.tx_errors);
+	printf("RTP inter arrival at the UAS (us) p50 <%lu p99 <%lu p99.9 <%lu\n",
+			result.uas.InterarrivalPercentile(0.5),
+			result.uas.InterarrivalPercentile(0.99),
+			result.uas.InterarrivalPercentile(0.999));
+}
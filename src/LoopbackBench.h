@@ -0,0 +1,60 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+
+#include "CallGenerator.h"
+#include "RtpStats.h"
+
+//what a benchmark run came to - the UAC figures are ours, the UAS ones come back from the child
+struct BenchResult
+{
+	double   elapsed_sec;   //from the generator starting to it being stopped
+	uint64_t attempts;
+	uint64_t failed;
+	uint64_t suppressed;
+	uint64_t answered;      //placed calls that got a 200 OK
+	uint64_t uas_answered;  //calls the UAS answered
+	RtpSnapshot uac;
+	RtpSnapshot uas;
+};
+
+//a capacity test in one command - the UAS is a forked child running the server side against our listeners on
+//loopback, and we are the UAC running the generator against it for a fixed time. The child hands its figures back
+//through a shared block when it is told to stop, and we print one report for the run
+class LoopbackBench {
+public:
+	typedef std::function<uint32_t()> ActiveCallsFn;
+	typedef std::function<uint64_t()> AnsweredFn;
+
+	//maps the shared block - call before any threads are started, pjsua included
+	LoopbackBench();
+	~LoopbackBench();
+
+	//start the UAS - true in the child, which goes on to run as the server. Exits if the fork fails
+	bool Fork();
+
+	//UAS side - run until the UAC is done with us, then hand back our figures
+	void Serve(AnsweredFn answered);
+
+	//UAC side - generate for duration (or until the generator has placed all its calls), hang up what is left,
+	//stop the UAS and gather up both sides
+	void Run(std::chrono::seconds duration, CallGenerator& generator, ActiveCallsFn active_calls,
+			AnsweredFn answered, BenchResult& result);
+
+	static void PrintResult(const BenchResult& result);
+
+private:
+	struct Shared
+	{
+		uint64_t    answered;
+		RtpSnapshot rtp;
+		bool        done;
+	};
+
+	Shared* shared; //MAP_SHARED - only read by us once the child has been reaped
+	pid_t child;
+};
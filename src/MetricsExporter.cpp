@@ -0,0 +1,327 @@
+#include "MetricsExporter.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "RtpStats.h"
+
+MetricsExporter::MetricsExporter(uint16_t _port, std::chrono::milliseconds _interval, ActiveCallsFn active_calls,
+		const CallGenerator* _generator):
+		port(_port),interval(_interval),activeCalls(active_calls),generator(_generator),
+		cleared(new DisconnectStats::Snapshot),latency(new LatencyHistogram::Snapshot),
+		lastRefresh(std::chrono::steady_clock::now()),lastAttempts(0),lastCleared(0),listenFd(-1),stop(false)
+{
+}
+
+MetricsExporter::~MetricsExporter()
+{
+	Stop();
+}
+
+void MetricsExporter::Start()
+{
+	sockaddr_in addr;
+	int on = 1;
+
+	listenFd = socket(AF_INET, SOCK_STREAM, 0);
+	if (listenFd < 0)
+	{
+		std::cerr << "WTF - cannot create metrics socket: " << strerror(errno) << std::endl;
+		exit(-1);
+	}
+	setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(listenFd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(listenFd, 16) != 0)
+	{
+		std::cerr << "WTF - cannot listen for metrics on 127.0.0.1:" << port << ": " << strerror(errno) << std::endl;
+		exit(-1);
+	}
+
+	//have something to serve before the first scrape can arrive
+	Refresh();
+
+	stop = false;
+	refreshThread = std::thread(&MetricsExporter::RunRefresh, this);
+	serverThread = std::thread(&MetricsExporter::RunServer, this);
+}
+
+void MetricsExporter::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stop = true;
+	}
+	wakeup.notify_all();
+
+	if (refreshThread.joinable())
+		refreshThread.join();
+	if (serverThread.joinable())
+		serverThread.join();
+
+	if (listenFd >= 0)
+	{
+		close(listenFd);
+		listenFd = -1;
+	}
+}
+
+void MetricsExporter::RunRefresh()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (!wakeup.wait_for(lock, interval, [this]{ return bool(stop); }))
+	{
+		lock.unlock();
+		Refresh();
+		lock.lock();
+	}
+}
+
+//one connection at a time is plenty for a scraper - the poll timeout is just so we notice Stop()
+void MetricsExporter::RunServer()
+{
+	pollfd pfd;
+
+	pfd.fd = listenFd;
+	pfd.events = POLLIN;
+
+	while (!stop)
+	{
+		pfd.revents = 0;
+		if (poll(&pfd, 1, 200) <= 0)
+			continue;
+
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		//a client that connects and says nothing must not wedge us
+		timeval timeout = { 1, 0 };
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		Respond(fd);
+		close(fd);
+	}
+}
+
+void MetricsExporter::Respond(int fd)
+{
+	char request[4096];
+	size_t got = 0;
+
+	//we only need the request line, but read the headers so the client is not reset while still sending them
+	while (got < sizeof(request) - 1)
+	{
+		ssize_t n = recv(fd, request + got, sizeof(request) - 1 - got, 0);
+		if (n <= 0)
+			break;
+		got += n;
+		request[got] = 0;
+		if (strstr(request, "\r\n\r\n"))
+			break;
+	}
+	request[got] = 0;
+
+	std::shared_ptr<const Rendered> doc = std::atomic_load(&current);
+	const std::string* body = NULL;
+	const char* type = NULL;
+
+	if (strncmp(request, "GET /metrics.json ", 18) == 0)
+	{
+		body = &doc->json;
+		type = "application/json";
+	}
+	else if (strncmp(request, "GET /metrics ", 13) == 0 || strncmp(request, "GET / ", 6) == 0)
+	{
+		body = &doc->prometheus;
+		type = "text/plain; version=0.0.4";
+	}
+
+	char header[256];
+	int header_len;
+	if (body)
+		header_len = snprintf(header, sizeof(header),
+				"HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+				type, body->size());
+	else
+		header_len = snprintf(header, sizeof(header),
+				"HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n");
+
+	if (send(fd, header, header_len, MSG_NOSIGNAL) != header_len || !body)
+		return;
+
+	size_t sent = 0;
+	while (sent < body->size())
+	{
+		ssize_t n = send(fd, body->data() + sent, body->size() - sent, MSG_NOSIGNAL);
+		if (n <= 0)
+			return;
+		sent += n;
+	}
+}
+
+//append printf style to s
+static void appendf(std::string& s, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+static void appendf(std::string& s, const char* fmt, ...)
+{
+	char buf[512];
+	va_list args;
+
+	va_start(args, fmt);
+	int n = vsnprintf(buf, sizeof(buf), fmt, args);
+	va_end(args);
+
+	if (n > 0)
+		s.append(buf, (size_t)n < sizeof(buf) ? n : sizeof(buf) - 1);
+}
+
+void MetricsExporter::Refresh()
+{
+	std::shared_ptr<Rendered> doc(new Rendered);
+	std::string& p = doc->prometheus;
+	std::string& j = doc->json;
+
+	auto now = std::chrono::steady_clock::now();
+	double elapsed = std::chrono::duration<double>(now - lastRefresh).count();
+
+	uint32_t active = activeCalls();
+	uint64_t attempts = generator ? generator->Attempts() : 0;
+
+	DisconnectStats::Take(*cleared);
+
+	RtpSnapshot rtp;
+	RtpStats::TakeTotal(rtp);
+
+	double offered_cps = elapsed > 0 ? (attempts - lastAttempts) / elapsed : 0;
+	double cleared_cps = elapsed > 0 ? (cleared->total - lastCleared) / elapsed : 0;
+	lastRefresh = now;
+	lastAttempts = attempts;
+	lastCleared = cleared->total;
+
+	p.reserve(64 * 1024);
+	j.reserve(64 * 1024);
+
+	p += "# TYPE pjsipi_active_calls gauge\n";
+	appendf(p, "pjsipi_active_calls %u\n", active);
+	p += "# TYPE pjsipi_offered_cps gauge\n";
+	appendf(p, "pjsipi_offered_cps %.3f\n", offered_cps);
+	p += "# TYPE pjsipi_cleared_cps gauge\n";
+	appendf(p, "pjsipi_cleared_cps %.3f\n", cleared_cps);
+
+	appendf(j, "{\"active_calls\":%u,\"offered_cps\":%.3f,\"cleared_cps\":%.3f", active, offered_cps, cleared_cps);
+
+	if (generator)
+	{
+		p += "# TYPE pjsipi_generator_attempts_total counter\n";
+		appendf(p, "pjsipi_generator_attempts_total %lu\n", attempts);
+		p += "# TYPE pjsipi_generator_failed_total counter\n";
+		appendf(p, "pjsipi_generator_failed_total %lu\n", generator->Failed());
+		p += "# TYPE pjsipi_generator_suppressed_total counter\n";
+		appendf(p, "pjsipi_generator_suppressed_total %lu\n", generator->Suppressed());
+		p += "# TYPE pjsipi_generator_late_total counter\n";
+		appendf(p, "pjsipi_generator_late_total %lu\n", generator->Late());
+
+		appendf(j, ",\"generator\":{\"running\":%s,\"attempts\":%lu,\"failed\":%lu,\"suppressed\":%lu,\"late\":%lu}",
+				generator->Running() ? "true" : "false", attempts, generator->Failed(), generator->Suppressed(),
+				generator->Late());
+	}
+
+	p += "# TYPE pjsipi_calls_cleared_total counter\n";
+	appendf(j, ",\"calls_cleared\":{\"total\":%lu,\"by_code\":[", cleared->total);
+	bool first = true;
+	for (auto type : eCallType::_values())
+	{
+		for (unsigned dir=0; dir<DisconnectStats::DIRECTIONS; dir++)
+		{
+			for (unsigned code=0; code<DisconnectStats::CODES; code++)
+			{
+				uint64_t count = cleared->counts[type._to_integral()][dir][code];
+				if (count == 0)
+					continue;
+
+				const char* direction = dir ? "bi" : "uni";
+				appendf(p, "pjsipi_calls_cleared_total{code=\"%u\",type=\"%s\",direction=\"%s\"} %lu\n",
+						code, type._to_string(), direction, count);
+				appendf(j, "%s{\"code\":%u,\"type\":\"%s\",\"direction\":\"%s\",\"count\":%lu}",
+						first ? "" : ",", code, type._to_string(), direction, count);
+				first = false;
+			}
+		}
+	}
+	j += "]}";
+
+	const struct { const char* name; uint64_t value; } rtp_counters[] =
+	{
+		{ "rx_packets", rtp.rx_packets },
+		{ "rx_bytes", rtp.rx_bytes },
+		{ "rx_rtcp_packets", rtp.rx_rtcp_packets },
+		{ "rx_rtcp_bytes", rtp.rx_rtcp_bytes },
+		{ "tx_packets", rtp.tx_packets },
+		{ "tx_bytes", rtp.tx_bytes },
+		{ "tx_rtcp_packets", rtp.tx_rtcp_packets },
+		{ "tx_rtcp_bytes", rtp.tx_rtcp_bytes },
+		{ "tx_errors", rtp.tx_errors },
+	};
+
+	j += ",\"rtp\":{";
+	first = true;
+	for (auto& counter : rtp_counters)
+	{
+		appendf(p, "# TYPE pjsipi_rtp_%s_total counter\npjsipi_rtp_%s_total %lu\n", counter.name, counter.name, counter.value);
+		appendf(j, "%s\"%s\":%lu", first ? "" : ",", counter.name, counter.value);
+		first = false;
+	}
+
+	const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+	p += "# TYPE pjsipi_rtp_interarrival_microseconds gauge\n";
+	j += ",\"interarrival_us\":{";
+	first = true;
+	for (double q : quantiles)
+	{
+		uint64_t value = rtp.InterarrivalPercentile(q);
+		appendf(p, "pjsipi_rtp_interarrival_microseconds{quantile=\"%g\"} %lu\n", q, value);
+		appendf(j, "%s\"p%g\":%lu", first ? "" : ",", q * 100, value);
+		first = false;
+	}
+	j += "}}";
+
+	p += "# TYPE pjsipi_latency_microseconds summary\n";
+	j += ",\"latency_us\":{";
+	first = true;
+	for (auto milestone : eLatencyMilestone::_values())
+	{
+		CallLatency::Take(milestone, *latency);
+
+		appendf(j, "%s\"%s\":{\"count\":%lu,\"sum\":%lu,\"max\":%lu", first ? "" : ",", milestone._to_string(),
+				latency->count, latency->sum, latency->max);
+		for (double q : quantiles)
+		{
+			uint64_t value = latency->Percentile(q);
+			appendf(p, "pjsipi_latency_microseconds{milestone=\"%s\",quantile=\"%g\"} %lu\n",
+					milestone._to_string(), q, value);
+			appendf(j, ",\"p%g\":%lu", q * 100, value);
+		}
+		appendf(p, "pjsipi_latency_microseconds_sum{milestone=\"%s\"} %lu\n", milestone._to_string(), latency->sum);
+		appendf(p, "pjsipi_latency_microseconds_count{milestone=\"%s\"} %lu\n", milestone._to_string(), latency->count);
+		j += "}";
+		first = false;
+	}
+	j += "}}\n";
+
+	std::atomic_store(&current, std::shared_ptr<const Rendered>(doc));
+}
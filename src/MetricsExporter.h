@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "CallGenerator.h"
+#include "DisconnectStats.h"
+#include "LatencyHistogram.h"
+
+//serves our counters over HTTP on the loopback interface - GET /metrics for Prometheus text, GET /metrics.json for
+//JSON. One thread rebuilds both documents every interval from the lock free stats; the server thread only ever
+//hands out the last one built, so a scrape never touches pjsua or anything the signalling threads lock
+class MetricsExporter {
+public:
+	typedef std::function<uint32_t()> ActiveCallsFn;
+
+	//generator may be NULL (we are a server)
+	MetricsExporter(uint16_t port, std::chrono::milliseconds interval, ActiveCallsFn active_calls,
+			const CallGenerator* generator);
+	~MetricsExporter();
+
+	void Start();
+	void Stop();
+
+private:
+	struct Rendered
+	{
+		std::string prometheus;
+		std::string json;
+	};
+
+	void RunRefresh();
+	void RunServer();
+	void Refresh();
+	void Respond(int fd);
+
+	const uint16_t port;
+	const std::chrono::milliseconds interval;
+	ActiveCallsFn activeCalls;
+	const CallGenerator* generator;
+
+	std::shared_ptr<const Rendered> current; //only ever touched with std::atomic_load / std::atomic_store
+
+	//scratch for the refresh thread - big enough that we do not want them on the stack or reallocated every time
+	std::unique_ptr<DisconnectStats::Snapshot> cleared;
+	std::unique_ptr<LatencyHistogram::Snapshot> latency;
+
+	//what the rates were worked out from last time
+	std::chrono::steady_clock::time_point lastRefresh;
+	uint64_t lastAttempts;
+	uint64_t lastCleared;
+
+	int listenFd;
+	std::thread refreshThread;
+	std::thread serverThread;
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::atomic<bool> stop;
+};
@@ -0,0 +1,146 @@
+#include "NullMediaTransport.h"
+
+#define THIS_FILE "NULL_MEDIA"
+
+//RFC 863 - the port the SDP advertises. 0 would reject the media line, and we want it negotiated, just not used
+#define DISCARD_PORT 9
+
+pj_sockaddr NullMediaTransport::address;
+
+namespace {
+
+//the SDP has the media inactive, so nothing is attached and nothing is sent - these are only here for pjsua
+pj_status_t null_get_info(pjmedia_transport *tp, pjmedia_transport_info *info);
+void null_detach(pjmedia_transport *tp, void *strm);
+pj_status_t null_send(pjmedia_transport *tp, const void *pkt, pj_size_t size);
+pj_status_t null_send_rtcp2(pjmedia_transport *tp, const pj_sockaddr_t *addr, unsigned addr_len, const void *pkt,
+		pj_size_t size);
+pj_status_t null_media_create(pjmedia_transport *tp, pj_pool_t *sdp_pool, unsigned options,
+		const pjmedia_sdp_session *rem_sdp, unsigned media_index);
+pj_status_t null_encode_sdp(pjmedia_transport *tp, pj_pool_t *sdp_pool, pjmedia_sdp_session *local_sdp,
+		const pjmedia_sdp_session *rem_sdp, unsigned media_index);
+pj_status_t null_media_start(pjmedia_transport *tp, pj_pool_t *pool, const pjmedia_sdp_session *local_sdp,
+		const pjmedia_sdp_session *rem_sdp, unsigned media_index);
+pj_status_t null_media_stop(pjmedia_transport *tp);
+pj_status_t null_simulate_lost(pjmedia_transport *tp, pjmedia_dir dir, unsigned pct_lost);
+pj_status_t null_destroy(pjmedia_transport *tp);
+pj_status_t null_attach2(pjmedia_transport *tp, pjmedia_transport_attach_param *att_param);
+
+struct pjmedia_transport_op null_op =
+{
+		&null_get_info,
+		NULL,
+		&null_detach,
+		&null_send,
+		&null_send,
+		&null_send_rtcp2,
+		&null_media_create,
+		&null_encode_sdp,
+		&null_media_start,
+		&null_media_stop,
+		&null_simulate_lost,
+		&null_destroy,
+		&null_attach2,
+};
+
+struct null_transport
+{
+	pjmedia_transport base;
+	pj_pool_t        *pool;
+	pj_sockaddr       address;
+};
+
+pj_status_t null_get_info(pjmedia_transport *tp, pjmedia_transport_info *info)
+{
+	struct null_transport *null_tp = (struct null_transport*)tp;
+
+	info->sock_info.rtp_sock = PJ_INVALID_SOCKET;
+	info->sock_info.rtcp_sock = PJ_INVALID_SOCKET;
+	pj_memcpy(&info->sock_info.rtp_addr_name, &null_tp->address, sizeof(pj_sockaddr));
+	pj_memcpy(&info->sock_info.rtcp_addr_name, &null_tp->address, sizeof(pj_sockaddr));
+	pj_sockaddr_set_port(&info->sock_info.rtcp_addr_name, DISCARD_PORT + 1);
+	return PJ_SUCCESS;
+}
+
+void null_detach(pjmedia_transport *tp, void *strm)
+{
+}
+
+pj_status_t null_send(pjmedia_transport *tp, const void *pkt, pj_size_t size)
+{
+	return PJ_SUCCESS;
+}
+
+pj_status_t null_send_rtcp2(pjmedia_transport *tp, const pj_sockaddr_t *addr, unsigned addr_len, const void *pkt,
+		pj_size_t size)
+{
+	return PJ_SUCCESS;
+}
+
+pj_status_t null_media_create(pjmedia_transport *tp, pj_pool_t *sdp_pool, unsigned options,
+		const pjmedia_sdp_session *rem_sdp, unsigned media_index)
+{
+	return PJ_SUCCESS;
+}
+
+pj_status_t null_encode_sdp(pjmedia_transport *tp, pj_pool_t *sdp_pool, pjmedia_sdp_session *local_sdp,
+		const pjmedia_sdp_session *rem_sdp, unsigned media_index)
+{
+	return PJ_SUCCESS;
+}
+
+pj_status_t null_media_start(pjmedia_transport *tp, pj_pool_t *pool, const pjmedia_sdp_session *local_sdp,
+		const pjmedia_sdp_session *rem_sdp, unsigned media_index)
+{
+	return PJ_SUCCESS;
+}
+
+pj_status_t null_media_stop(pjmedia_transport *tp)
+{
+	return PJ_SUCCESS;
+}
+
+pj_status_t null_simulate_lost(pjmedia_transport *tp, pjmedia_dir dir, unsigned pct_lost)
+{
+	return PJ_SUCCESS;
+}
+
+pj_status_t null_destroy(pjmedia_transport *tp)
+{
+	pj_pool_release(((struct null_transport*)tp)->pool);
+	return PJ_SUCCESS;
+}
+
+//a far end that ignores our a=inactive still gets nothing from us - there is no socket to take its packets
+pj_status_t null_attach2(pjmedia_transport *tp, pjmedia_transport_attach_param *att_param)
+{
+	return PJ_SUCCESS;
+}
+
+}
+
+void NullMediaTransport::Init()
+{
+	if (pj_gethostip(pj_AF_INET(), &address) != PJ_SUCCESS)
+	{
+		PJ_LOG(2,(THIS_FILE, "Cannot find our own address - advertising the media on the loopback"));
+		pj_sockaddr_init(pj_AF_INET(), &address, NULL, 0);
+		address.ipv4.sin_addr.s_addr = pj_htonl(0x7f000001);
+	}
+	pj_sockaddr_set_port(&address, DISCARD_PORT);
+}
+
+pj_status_t NullMediaTransport::Create(pjmedia_endpt* endpt, pjmedia_transport** p_tp)
+{
+	pj_pool_t* pool = pjmedia_endpt_create_pool(endpt, "nulltp%p", 256, 256);
+	struct null_transport* null_tp = PJ_POOL_ZALLOC_T(pool, struct null_transport);
+
+	null_tp->pool = pool;
+	pj_ansi_strncpy(null_tp->base.name, pool->obj_name, sizeof(null_tp->base.name));
+	null_tp->base.type = (pjmedia_transport_type)(PJMEDIA_TRANSPORT_TYPE_USER + 2);
+	null_tp->base.op = &null_op;
+	pj_memcpy(&null_tp->address, &address, sizeof(address));
+
+	*p_tp = &null_tp->base;
+	return PJ_SUCCESS;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+//a media transport with no sockets behind it, for signalling only runs. It hands pjsua an address to put in the SDP
+//and takes whatever it is asked to send without sending it - the SDP offers the media inactive, so no stream is ever
+//attached to it anyway. What that leaves of a call is the SIP and ISUP, which is what is being measured
+class NullMediaTransport {
+public:
+	//the address every call advertises - our own, with the discard port, so nothing much comes of anyone sending to it
+	static void Init();
+
+	static pj_status_t Create(pjmedia_endpt* endpt, pjmedia_transport** p_tp);
+
+private:
+	static pj_sockaddr address;
+};
@@ -0,0 +1,320 @@
+#include "PacketCapture.h"
+#include "SpscRing.h"
+
+#include <arpa/inet.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+#define THIS_FILE "PACKET_CAPTURE"
+
+namespace {
+
+//the most of a packet kept - a UDP payload in a 1500 byte MTU
+const unsigned MAX_CAPTURE = 1472;
+
+const unsigned IP_UDP_HEADER = 20 + 8;
+
+//LINKTYPE_IPV4 - the records start at the IP header
+const uint32_t LINKTYPE_IPV4 = 228;
+
+//pcap with nanosecond time stamps
+const uint32_t PCAP_MAGIC_NS = 0xa1b23c4d;
+
+struct Record
+{
+	uint64_t ns;      //CLOCK_REALTIME, which is what pcap wants
+	PcapFlow flow;
+	bool     sent;
+	bool     rtcp;
+	uint16_t caplen;  //bytes in data
+	uint16_t origlen; //bytes the packet really had
+	uint8_t  data[MAX_CAPTURE];
+};
+
+PcapConfig config;
+std::mutex ringsMutex;            //only held registering a ring, and by the writer while it drains
+std::thread writerThread;
+FILE* file = NULL;
+uint64_t fileBytes = 0;
+unsigned fileIndex = 0;
+uint64_t reopenNs = 0;            //when a file that could not be opened is tried again
+std::deque<std::string> files;    //oldest first
+
+uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+//RFC 1071 - only for the IP header we make up, so it can be slow and simple
+uint16_t ip_checksum(const uint8_t* hdr, size_t len)
+{
+	uint32_t sum = 0;
+
+	for (size_t i=0; i+1<len; i+=2)
+		sum += (hdr[i] << 8) | hdr[i+1];
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+	return htons(~sum & 0xffff);
+}
+
+}
+
+struct PacketCapture::Ring : public SpscRing<Record, 4096>
+{
+};
+
+std::vector<PacketCapture::Ring*> PacketCapture::rings;
+std::atomic<bool> PacketCapture::running(false);
+std::atomic<uint64_t> PacketCapture::callsSeen(0);
+std::atomic<uint64_t> PacketCapture::captured(0);
+std::atomic<uint64_t> PacketCapture::dropped(0);
+
+void PacketCapture::Start(const PcapConfig& _config)
+{
+	if (_config.prefix.empty() || running)
+		return;
+
+	config = _config;
+	if (!config.every_call)
+		config.every_call = 1;
+	if (!config.every_packet)
+		config.every_packet = 1;
+
+	OpenFile();
+	if (!file)
+	{
+		std::cerr << "WTF - cannot open capture file " << config.prefix << "-0001.pcap" << std::endl;
+		exit(-1);
+	}
+
+	running = true;
+	writerThread = std::thread(&PacketCapture::RunWriter);
+}
+
+void PacketCapture::Stop()
+{
+	if (!running.exchange(false))
+		return;
+
+	if (writerThread.joinable())
+		writerThread.join();
+
+	if (file)
+	{
+		fclose(file);
+		file = NULL;
+	}
+
+	PJ_LOG(3,(THIS_FILE, "Captured %lu packets, dropped %lu", Captured(), Dropped()));
+}
+
+bool PacketCapture::SampleCall()
+{
+	if (!running.load(std::memory_order_relaxed))
+		return false;
+	return callsSeen.fetch_add(1, std::memory_order_relaxed) % config.every_call == 0;
+}
+
+//every media thread gets a ring of its own the first time it captures - the rings live as long as the process, as
+//the threads do
+PacketCapture::Ring* PacketCapture::ThisThreadRing()
+{
+	static __thread Ring* ring = NULL;
+
+	if (!ring)
+	{
+		void* mem;
+		if (posix_memalign(&mem, alignof(Ring), sizeof(Ring)) != 0)
+			return NULL;
+		ring = new (mem) Ring;
+
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		rings.push_back(ring);
+	}
+	return ring;
+}
+
+void PacketCapture::Capture(const PcapFlow& flow, uint32_t& packets, bool sent, bool rtcp, const void* pkt, pj_ssize_t size)
+{
+	if (!running.load(std::memory_order_relaxed) || size <= 0)
+		return;
+
+	//packets is shared by the send and receive sides of the adapter without a lock - a lost count just moves which
+	//packet is sampled
+	if (packets++ % config.every_packet != 0)
+		return;
+
+	Ring* ring = ThisThreadRing();
+	if (!ring)
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	Record* record = ring->Claim();
+	if (!record)
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	const uint8_t* data = (const uint8_t*)pkt;
+	size_t len = size;
+
+	//just the fixed header, the CSRCs and any extension - enough to follow sequence numbers and timestamps
+	if (!config.payload && !rtcp && len >= 12)
+	{
+		size_t header = 12 + 4 * (data[0] & 0x0f);
+		if ((data[0] & 0x10) && len >= header + 4)
+			header += 4 + 4 * ((data[header + 2] << 8) | data[header + 3]);
+		len = std::min(len, header);
+	}
+	len = std::min(len, (size_t)MAX_CAPTURE);
+
+	record->ns = now_ns();
+	record->flow = flow;
+	record->sent = sent;
+	record->rtcp = rtcp;
+	record->caplen = len;
+	record->origlen = std::min(size, (pj_ssize_t)(0xffff - IP_UDP_HEADER));
+	memcpy(record->data, data, len);
+
+	ring->Commit();
+	captured.fetch_add(1, std::memory_order_relaxed);
+}
+
+void PacketCapture::OpenFile()
+{
+	if (file)
+		fclose(file);
+
+	char name[32];
+	snprintf(name, sizeof(name), "-%04u.pcap", ++fileIndex);
+	files.push_back(config.prefix + name);
+
+	file = fopen(files.back().c_str(), "wb");
+	fileBytes = 0;
+	if (!file)
+	{
+		//never made, so it is not one of the files kept
+		files.pop_back();
+		return;
+	}
+
+	uint32_t header[6];
+	header[0] = PCAP_MAGIC_NS;
+	header[1] = 2 | (4 << 16); //version 2.4
+	header[2] = 0;             //GMT offset
+	header[3] = 0;             //time stamp accuracy
+	header[4] = 0xffff;        //snap length
+	header[5] = LINKTYPE_IPV4;
+	fileBytes += fwrite(header, 1, sizeof(header), file);
+
+	while (config.keep_files && files.size() > config.keep_files)
+	{
+		unlink(files.front().c_str());
+		files.pop_front();
+	}
+}
+
+//write everything the rings hold - returns false if there was nothing
+bool PacketCapture::Drain()
+{
+	bool any = false;
+	uint8_t ip_udp[IP_UDP_HEADER];
+
+	std::lock_guard<std::mutex> lock(ringsMutex);
+
+	for (Ring* ring : rings)
+	{
+		for (Record* queued; (queued = ring->Peek()); ring->Pop())
+		{
+			const Record& record = *queued;
+			const PcapFlow& flow = record.flow;
+			uint16_t local_port = record.rtcp ? flow.local_rtcp_port : flow.local_rtp_port;
+			uint16_t remote_port = record.rtcp ? flow.remote_rtcp_port : flow.remote_rtp_port;
+			uint32_t src_ip = record.sent ? flow.local_ip : flow.remote_ip;
+			uint32_t dst_ip = record.sent ? flow.remote_ip : flow.local_ip;
+			uint16_t src_port = record.sent ? local_port : remote_port;
+			uint16_t dst_port = record.sent ? remote_port : local_port;
+			uint16_t ip_len = htons(IP_UDP_HEADER + record.origlen);
+			uint16_t udp_len = htons(8 + record.origlen);
+			uint16_t frag = htons(0x4000); //don't fragment
+
+			memset(ip_udp, 0, sizeof(ip_udp));
+			ip_udp[0] = 0x45;
+			memcpy(&ip_udp[2], &ip_len, 2);
+			memcpy(&ip_udp[6], &frag, 2);
+			ip_udp[8] = 64;
+			ip_udp[9] = 17; //UDP
+			memcpy(&ip_udp[12], &src_ip, 4);
+			memcpy(&ip_udp[16], &dst_ip, 4);
+			uint16_t checksum = ip_checksum(ip_udp, 20);
+			memcpy(&ip_udp[10], &checksum, 2);
+			memcpy(&ip_udp[20], &src_port, 2);
+			memcpy(&ip_udp[22], &dst_port, 2);
+			memcpy(&ip_udp[24], &udp_len, 2);
+
+			uint32_t header[4];
+			header[0] = record.ns / 1000000000ull;
+			header[1] = record.ns % 1000000000ull;
+			header[2] = IP_UDP_HEADER + record.caplen;
+			header[3] = IP_UDP_HEADER + record.origlen;
+
+			//only roll over with a packet to put in the new file - so Stop never leaves an empty one behind. A file
+			//that could not be opened is tried again a second later, rather than capture stopping for good
+			if (file ? (config.rotate_bytes && fileBytes >= config.rotate_bytes) : record.ns >= reopenNs)
+			{
+				OpenFile();
+				if (!file)
+				{
+					PJ_LOG(1,(THIS_FILE, "Cannot open capture file %s-%04u.pcap - packets are being thrown away until it can be",
+							config.prefix.c_str(), fileIndex));
+					reopenNs = record.ns + 1000000000ull;
+				}
+			}
+
+			if (file)
+			{
+				fileBytes += fwrite(header, 1, sizeof(header), file);
+				fileBytes += fwrite(ip_udp, 1, sizeof(ip_udp), file);
+				fileBytes += fwrite(record.data, 1, record.caplen, file);
+			}
+			any = true;
+		}
+	}
+
+	return any;
+}
+
+void PacketCapture::RunWriter()
+{
+	pj_thread_desc thread_desc;
+	pj_thread_t* thread;
+	pj_thread_register("pcap_writer", thread_desc, &thread);
+
+	//nap when the rings are empty - at 20ms a packet per stream, 5ms is well inside what a ring can hold
+	while (running.load(std::memory_order_relaxed))
+	{
+		if (!Drain())
+			std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+
+	Drain();
+	if (file)
+		fflush(file);
+}
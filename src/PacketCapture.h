@@ -0,0 +1,67 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//what goes in the pcap files and how often they roll over
+struct PcapConfig
+{
+	std::string prefix;        //files are prefix-0001.pcap, prefix-0002.pcap ...
+	bool        payload;       //whole packets - otherwise only the RTP header (RTCP is all header, so always whole)
+	unsigned    every_call;    //capture one call in this many
+	unsigned    every_packet;  //and one packet in this many of a captured call
+	uint64_t    rotate_bytes;  //start a new file once the current one is this big, 0 to never start another
+	unsigned    keep_files;    //delete the oldest beyond this many files, 0 to keep them all
+};
+
+//the addresses of a call's media, IPv4 addresses and ports in network order - the adapter only sees RTP, so the IP and UDP headers are
+//made up from these as the packets are written. All 0 for IPv6, which still captures but without addresses
+struct PcapFlow
+{
+	uint32_t local_ip;
+	uint32_t remote_ip;
+	uint16_t local_rtp_port;
+	uint16_t local_rtcp_port;
+	uint16_t remote_rtp_port;
+	uint16_t remote_rtcp_port;
+};
+
+//captures RTP and RTCP as the tp_adapter sends and receives it. The media threads copy the packets into a ring of
+//their own - single producer, single consumer, no locks - and a writer thread drains every ring into pcap files of
+//raw IPv4. When a ring is full the packet is dropped and counted rather than the media thread held up
+class PacketCapture {
+public:
+	//open the first file and start the writer - does nothing with an empty prefix
+	static void Start(const PcapConfig& config);
+
+	//drain what is left, close the file and stop the writer
+	static void Stop();
+
+	//whether the call whose media transport is being created should be captured - false when not capturing
+	static bool SampleCall();
+
+	//from the media thread handling the packet. packets counts the packets seen by this adapter, for sampling
+	static void Capture(const PcapFlow& flow, uint32_t& packets, bool sent, bool rtcp, const void* pkt, pj_ssize_t size);
+
+	static uint64_t Captured() { return captured.load(std::memory_order_relaxed); }
+	static uint64_t Dropped() { return dropped.load(std::memory_order_relaxed); }
+
+private:
+	struct Ring;
+
+	static Ring* ThisThreadRing();
+	static void RunWriter();
+	static bool Drain();
+	static void OpenFile();
+
+	static std::vector<Ring*> rings;
+	static std::atomic<bool> running;
+	static std::atomic<uint64_t> callsSeen;
+	static std::atomic<uint64_t> captured;
+	static std::atomic<uint64_t> dropped;
+};
@@ -0,0 +1,149 @@
+#include "PayloadCache.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#define THIS_FILE "PAYLOAD_CACHE"
+
+#define SAMPLE_RATE 8000
+
+//about -12dBFS - loud enough to see on a trace without clipping
+#define TONE_AMPLITUDE 8000
+
+namespace {
+
+uint32_t le32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+uint16_t le16(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+}
+
+std::vector<uint8_t> PayloadCache::alaw;
+std::vector<uint8_t> PayloadCache::ulaw;
+unsigned PayloadCache::frameBytes = 0;
+uint32_t PayloadCache::frames = 0;
+
+void PayloadCache::Init(ePayloadSource source, unsigned tone_hz, const std::string& file, unsigned samples_per_frame)
+{
+	std::vector<pj_int16_t> pcm;
+
+	frameBytes = samples_per_frame; //a byte a sample
+
+	switch (source)
+	{
+	case ePayloadSource::CODEC:
+		return;
+	case ePayloadSource::SILENCE:
+		pcm.assign(samples_per_frame, 0);
+		break;
+	case ePayloadSource::TONE:
+		//a whole number of cycles in a second - so the loop joins up
+		pcm.resize(SAMPLE_RATE);
+		for (unsigned i=0; i<pcm.size(); i++)
+			pcm[i] = (pj_int16_t)(TONE_AMPLITUDE * sin(2 * M_PI * tone_hz * i / SAMPLE_RATE));
+		break;
+	case ePayloadSource::FILE:
+		if (!Load(file, pcm) || pcm.empty())
+		{
+			std::cerr << "WTF - cannot use " << file << " as a payload - it has to be a WAV or raw 16 bit PCM, 8kHz mono" << std::endl;
+			exit(-1);
+		}
+		break;
+	}
+
+	//the last frame is filled out with silence
+	pcm.resize((pcm.size() + samples_per_frame - 1) / samples_per_frame * samples_per_frame, 0);
+	Encode(pcm);
+
+	PJ_LOG(3,(THIS_FILE, "Sending %s from %u encoded frames of %u bytes", source._to_string(), frames, frameBytes));
+}
+
+const uint8_t* PayloadCache::Frame(unsigned pt, uint32_t n)
+{
+	if (!frames)
+		return NULL;
+
+	switch (pt)
+	{
+	case PJMEDIA_RTP_PT_PCMA:
+		return &alaw[(n % frames) * frameBytes];
+	case PJMEDIA_RTP_PT_PCMU:
+		return &ulaw[(n % frames) * frameBytes];
+	default:
+		return NULL;
+	}
+}
+
+bool PayloadCache::Load(const std::string& file, std::vector<pj_int16_t>& pcm)
+{
+	std::ifstream in(file, std::ios::binary);
+	if (!in)
+		return false;
+
+	std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	const uint8_t* data = bytes.data();
+	size_t len = bytes.size();
+
+	//a WAV is walked chunk by chunk for its format and samples - anything else is taken to be the samples already
+	if (len >= 12 && memcmp(data, "RIFF", 4) == 0 && memcmp(data + 8, "WAVE", 4) == 0)
+	{
+		bool format_ok = false;
+		size_t offset = 12;
+
+		data = NULL;
+		while (offset + 8 <= len)
+		{
+			const uint8_t* chunk = &bytes[offset];
+			uint32_t size = le32(chunk + 4);
+
+			if (offset + 8 + size > len)
+				size = len - offset - 8;
+
+			if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
+			{
+				format_ok = le16(chunk + 8) == 1 && le16(chunk + 10) == 1 && le32(chunk + 12) == SAMPLE_RATE &&
+						le16(chunk + 22) == 16;
+			}
+			else if (memcmp(chunk, "data", 4) == 0)
+			{
+				data = chunk + 8;
+				len = size;
+				break;
+			}
+
+			offset += 8 + size + (size & 1);
+		}
+
+		if (!format_ok || !data)
+			return false;
+	}
+
+	pcm.resize(len / 2);
+	for (size_t i=0; i<pcm.size(); i++)
+		pcm[i] = (pj_int16_t)le16(data + i * 2);
+	return true;
+}
+
+void PayloadCache::Encode(const std::vector<pj_int16_t>& pcm)
+{
+	alaw.resize(pcm.size());
+	ulaw.resize(pcm.size());
+
+	for (size_t i=0; i<pcm.size(); i++)
+	{
+		alaw[i] = pjmedia_linear2alaw(pcm[i]);
+		ulaw[i] = pjmedia_linear2ulaw(pcm[i]);
+	}
+
+	frames = pcm.size() / frameBytes;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "Enum.h"
+
+//what DirectMedia sends - CODEC puts silence through the stream's encoder, the rest are sent from the cache
+ENUM(ePayloadSource, uint16_t, CODEC, SILENCE, TONE, FILE);
+
+//G.711 frames encoded once at startup, in both laws as we do not know which the far end will pick. Every call
+//loops over the same frames, so sending one is an RTP header and a copy - there is no per packet codec work left
+class PayloadCache {
+public:
+	//encode the frames - call before any call is made. The file is a WAV or raw 16 bit PCM, 8kHz mono either way,
+	//looped; the tone is a sine of tone_hz looped every second. Exits if the file cannot be used
+	static void Init(ePayloadSource source, unsigned tone_hz, const std::string& file, unsigned samples_per_frame);
+
+	static bool Enabled() { return frames != 0; }
+
+	//frame n, wrapped round, for payload type pt - NULL for anything but PCMA or PCMU
+	static const uint8_t* Frame(unsigned pt, uint32_t n);
+
+	static unsigned FrameBytes() { return frameBytes; }
+	static uint32_t Frames() { return frames; }
+
+private:
+	static bool Load(const std::string& file, std::vector<pj_int16_t>& pcm);
+	static void Encode(const std::vector<pj_int16_t>& pcm);
+
+	static std::vector<uint8_t> alaw;
+	static std::vector<uint8_t> ulaw;
+	static unsigned frameBytes;
+	static uint32_t frames;
+};
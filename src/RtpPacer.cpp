@@ -0,0 +1,243 @@
+#include "RtpPacer.h"
+#include "SpscRing.h"
+
+#include <sys/socket.h>
+#include <errno.h>
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#define THIS_FILE "RTP_PACER"
+
+namespace {
+
+//a UDP payload in a 1500 byte MTU - anything bigger is sent straight away
+const unsigned MAX_PACKET = 1472;
+
+struct Packet
+{
+	RtpPacerTarget* target;
+	uint16_t        len;
+	uint8_t         data[MAX_PACKET];
+};
+
+std::chrono::microseconds interval;
+unsigned batch;
+unsigned burst;
+std::mutex ringsMutex;  //only held registering a ring, and by the pacer while it sends
+std::thread pacerThread;
+
+//only touched by the pacer thread - sized for one sendmmsg when started
+std::vector<struct mmsghdr> msgs;
+std::vector<struct iovec> iovs;
+size_t firstRing = 0; //where the next Send starts, so a busy ring cannot keep the budget from the rest
+
+//stands in for a target that could not wait for its packets to go - they are still taken off the rings in order,
+//but go nowhere and count as send errors on the unbound slot
+RtpPacerTarget orphaned;
+
+//how long Forget waits for the pacer before it orphans what is left - the pacer gets round every ring in an
+//interval or two, so this is only reached when it has fallen well behind
+const std::chrono::milliseconds FORGET_WAIT(100);
+
+}
+
+struct RtpPacer::Ring : public SpscRing<Packet, 4096>
+{
+};
+
+std::vector<RtpPacer::Ring*> RtpPacer::rings;
+std::atomic<bool> RtpPacer::running(false);
+
+void RtpPacer::Start(std::chrono::microseconds _interval, unsigned _batch, unsigned _burst)
+{
+	if (running)
+		return;
+
+	interval = _interval;
+	batch = _batch ? _batch : 1;
+	burst = _burst ? _burst : UINT_MAX;
+	msgs.resize(batch);
+	iovs.resize(batch);
+	orphaned.fd = PJ_INVALID_SOCKET;
+	orphaned.addr_len = sizeof(orphaned.addr.ipv4);
+	orphaned.stats = RtpStats::Unbound();
+
+	running = true;
+	pacerThread = std::thread(&RtpPacer::RunPacer);
+}
+
+void RtpPacer::Stop()
+{
+	if (!running.exchange(false))
+		return;
+
+	if (pacerThread.joinable())
+		pacerThread.join();
+
+	//anything a sender managed to queue as we stopped still has to go, or its adapter would wait for it for ever
+	while (Send(UINT_MAX))
+		;
+}
+
+//every sending thread gets a ring of its own the first time it queues - the rings live as long as the process, as
+//the threads do
+RtpPacer::Ring* RtpPacer::ThisThreadRing()
+{
+	static __thread Ring* ring = NULL;
+
+	if (!ring)
+	{
+		void* mem;
+		if (posix_memalign(&mem, alignof(Ring), sizeof(Ring)) != 0)
+			return NULL;
+		ring = new (mem) Ring;
+
+		std::lock_guard<std::mutex> lock(ringsMutex);
+		rings.push_back(ring);
+	}
+	return ring;
+}
+
+bool RtpPacer::Queue(RtpPacerTarget* target, const void* pkt, pj_size_t size)
+{
+	if (!running.load(std::memory_order_relaxed) || size > MAX_PACKET)
+		return false;
+
+	Ring* ring = ThisThreadRing();
+	Packet* packet = ring ? ring->Claim() : NULL;
+	if (!packet)
+		return false;
+
+	packet->target = target;
+	packet->len = size;
+	memcpy(packet->data, pkt, size);
+
+	//counted before the pacer can see it, so the count never drops below what is really outstanding
+	target->queued.fetch_add(1, std::memory_order_relaxed);
+	ring->Commit();
+	return true;
+}
+
+void RtpPacer::Forget(RtpPacerTarget* target)
+{
+	auto give_up = std::chrono::steady_clock::now() + FORGET_WAIT;
+
+	//past the wait, what is left is handed to the orphaned target each time round - so a packet that was still being
+	//committed as we looked is caught the next time
+	while (target->queued.load(std::memory_order_acquire))
+	{
+		if (std::chrono::steady_clock::now() >= give_up)
+			Orphan(target);
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+//repoint every packet still queued for target at the orphaned target. The rings' consumer end is only ever worked
+//under ringsMutex, so holding it makes us the consumer for as long as we look
+void RtpPacer::Orphan(RtpPacerTarget* target)
+{
+	std::lock_guard<std::mutex> lock(ringsMutex);
+
+	for (Ring* ring : rings)
+	{
+		Packet* packet;
+		for (uint32_t i=0; (packet = ring->Peek(i)); i++)
+		{
+			if (packet->target != target)
+				continue;
+
+			packet->target = &orphaned;
+			orphaned.queued.fetch_add(1, std::memory_order_relaxed);
+			target->queued.fetch_sub(1, std::memory_order_release);
+		}
+	}
+}
+
+//send up to budget packets - returns how many were taken off the rings, sent or not
+unsigned RtpPacer::Send(unsigned budget)
+{
+	unsigned taken = 0;
+
+	std::lock_guard<std::mutex> lock(ringsMutex);
+
+	if (rings.empty())
+		return 0;
+
+	//start a ring further on each time - with a burst limit, whichever ring comes first may use it all up
+	size_t first = firstRing++ % rings.size();
+	for (size_t r=0; r<rings.size(); r++)
+	{
+		Ring* ring = rings[(first + r) % rings.size()];
+
+		while (taken < budget)
+		{
+			Packet* first = ring->Peek();
+			if (!first)
+				break;
+
+			//each stream has a socket of its own, so a sendmmsg can only carry a run of packets for the same one
+			unsigned n = 0;
+			for (Packet* packet; n < batch && taken + n < budget && (packet = ring->Peek(n)) &&
+					packet->target->fd == first->target->fd; n++)
+			{
+				iovs[n].iov_base = packet->data;
+				iovs[n].iov_len = packet->len;
+				memset(&msgs[n], 0, sizeof(msgs[n]));
+				msgs[n].msg_hdr.msg_name = &packet->target->addr;
+				msgs[n].msg_hdr.msg_namelen = packet->target->addr_len;
+				msgs[n].msg_hdr.msg_iov = &iovs[n];
+				msgs[n].msg_hdr.msg_iovlen = 1;
+			}
+
+			int sent = sendmmsg(first->target->fd, msgs.data(), n, 0);
+
+			//UDP - a packet the socket would not take is dropped, as pjmedia would have dropped it. Only the first
+			//of the run is given up on, the rest get another go
+			pj_status_t status = PJ_SUCCESS;
+			if (sent <= 0)
+			{
+				status = PJ_STATUS_FROM_OS(sent < 0 ? errno : EAGAIN);
+				sent = 1;
+			}
+
+			for (int i=0; i<sent; i++)
+			{
+				Packet* packet = ring->Peek(i);
+				packet->target->stats->CountTx(packet->len, status);
+				packet->target->queued.fetch_sub(1, std::memory_order_release); //the last we touch of the target
+			}
+			ring->Pop(sent);
+			taken += sent;
+		}
+	}
+
+	return taken;
+}
+
+void RtpPacer::RunPacer()
+{
+	pj_thread_desc thread_desc;
+	pj_thread_t* thread;
+	pj_thread_register("rtp_pacer", thread_desc, &thread);
+
+	auto next = std::chrono::steady_clock::now();
+
+	while (running.load(std::memory_order_relaxed))
+	{
+		next += interval;
+		std::this_thread::sleep_until(next);
+
+		Send(burst);
+
+		//fallen behind - start again from now rather than racing through the missed intervals with no pacing at all
+		auto now = std::chrono::steady_clock::now();
+		if (now > next + interval)
+			next = now;
+	}
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "RtpStats.h"
+
+//where a tp_adapter's paced RTP goes - filled in when the stream attaches. queued counts the packets the pacer has
+//still to send, and the adapter must not go away until it is back to 0
+struct RtpPacerTarget
+{
+	pj_sock_t             fd;       //the slave transport's RTP socket
+	pj_sockaddr           addr;     //the far end, as given to attach
+	unsigned              addr_len;
+	RtpCounters*          stats;
+	std::atomic<uint32_t> queued;
+};
+
+//takes RTP off the threads encoding it and sends it from a thread of its own. Each interval the pacer sends what has
+//been queued since the last one - no more than burst packets, so a tick's worth of streams does not land on the far
+//end's socket buffers all at once - with runs of packets for the same socket going out in one sendmmsg.
+//
+//Packets are queued on rings of the sending thread, so nothing on the media path takes a lock
+class RtpPacer {
+public:
+	//burst 0 for no limit. batch is the most packets given to one sendmmsg
+	static void Start(std::chrono::microseconds interval, unsigned batch, unsigned burst);
+
+	//sends whatever is still queued, then stops
+	static void Stop();
+
+	static bool Running() { return running.load(std::memory_order_relaxed); }
+
+	//copy the packet into this thread's ring - false if it is full or too big, when the caller should send it itself
+	static bool Queue(RtpPacerTarget* target, const void* pkt, pj_size_t size);
+
+	//wait until everything queued for target has gone - before the socket it names is closed. If the pacer has not
+	//got to it within a short wait, whatever is left is dropped instead
+	static void Forget(RtpPacerTarget* target);
+
+private:
+	struct Ring;
+
+	static Ring* ThisThreadRing();
+	static void RunPacer();
+	static unsigned Send(unsigned budget);
+	static void Orphan(RtpPacerTarget* target);
+
+	static std::vector<Ring*> rings;
+	static std::atomic<bool> running;
+};
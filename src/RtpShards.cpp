@@ -0,0 +1,213 @@
+#include "RtpShards.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define THIS_FILE "RTP_SHARDS"
+
+namespace {
+
+//a UDP payload in a 1500 byte MTU
+const unsigned MAX_DATAGRAM = 1472;
+
+//far end IPv4 address and port, as they sit in the sockaddr
+uint64_t key_of(uint32_t addr, uint16_t port)
+{
+	return ((uint64_t)addr << 16) | port;
+}
+
+}
+
+struct RtpShards::Shard
+{
+	int      fd;
+	uint16_t port;
+	unsigned cpu;
+	unsigned batch;
+
+	//held by the shard thread while it delivers a batch - so Unbind cannot return with a delivery under way
+	std::mutex mutex;
+	std::unordered_map<uint64_t, void*> streams;
+
+	std::atomic<uint64_t> strays;
+	std::thread thread;
+};
+
+RtpShards::Shard* RtpShards::shards = NULL;
+unsigned RtpShards::count = 0;
+RtpShards::DeliverFn RtpShards::deliver = NULL;
+std::atomic<bool> RtpShards::running(false);
+std::atomic<unsigned> RtpShards::next(0);
+
+void RtpShards::Start(unsigned _count, uint16_t base_port, unsigned first_cpu, unsigned batch, DeliverFn _deliver)
+{
+	if (running || !_count)
+		return;
+
+	deliver = _deliver;
+	count = _count;
+	shards = new Shard[count];
+
+	unsigned cpus = std::thread::hardware_concurrency();
+
+	for (unsigned i=0; i<count; i++)
+	{
+		Shard& shard = shards[i];
+		struct sockaddr_in addr;
+		struct timeval timeout = { 0, 100000 }; //so the thread notices Stop
+		int rcvbuf = 8 * 1024 * 1024;
+
+		shard.port = base_port + i;
+		shard.cpu = cpus ? (first_cpu + i) % cpus : 0;
+		shard.batch = batch ? batch : 1;
+		shard.strays = 0;
+		shard.fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(shard.port);
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+		if (shard.fd < 0 || bind(shard.fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+		{
+			std::cerr << "WTF - cannot bind RTP shard socket on port " << shard.port << ": " << strerror(errno) << std::endl;
+			exit(-1);
+		}
+
+		//a shard takes what a few hundred stream sockets would have between them - the buffer has to be to match
+		setsockopt(shard.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+		setsockopt(shard.fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	}
+
+	running = true;
+	for (unsigned i=0; i<count; i++)
+		shards[i].thread = std::thread(&RtpShards::Run, &shards[i]);
+
+	PJ_LOG(3,(THIS_FILE, "Receiving RTP on %u shards, ports %u to %u", count, base_port, base_port + count - 1));
+}
+
+void RtpShards::Stop()
+{
+	if (!running.exchange(false))
+		return;
+
+	for (unsigned i=0; i<count; i++)
+	{
+		if (shards[i].thread.joinable())
+			shards[i].thread.join();
+		close(shards[i].fd);
+	}
+}
+
+int RtpShards::Assign()
+{
+	if (!Running())
+		return -1;
+	return next.fetch_add(1, std::memory_order_relaxed) % count;
+}
+
+uint16_t RtpShards::Port(int shard)
+{
+	return shards[shard].port;
+}
+
+pj_sock_t RtpShards::Socket(int shard)
+{
+	return shards[shard].fd;
+}
+
+bool RtpShards::Bind(int index, const pj_sockaddr& remote, void* owner)
+{
+	if (remote.addr.sa_family != pj_AF_INET())
+		return false;
+
+	Shard& shard = shards[index];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	//a stream can only be told apart by where it comes from - a second one from the same place takes over
+	shard.streams[key_of(remote.ipv4.sin_addr.s_addr, remote.ipv4.sin_port)] = owner;
+	return true;
+}
+
+void RtpShards::Unbind(int index, const pj_sockaddr& remote, void* owner)
+{
+	Shard& shard = shards[index];
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	auto it = shard.streams.find(key_of(remote.ipv4.sin_addr.s_addr, remote.ipv4.sin_port));
+	if (it != shard.streams.end() && it->second == owner)
+		shard.streams.erase(it);
+}
+
+uint64_t RtpShards::Strays()
+{
+	uint64_t sum = 0;
+
+	for (unsigned i=0; i<count; i++)
+		sum += shards[i].strays.load(std::memory_order_relaxed);
+	return sum;
+}
+
+void RtpShards::Run(Shard* shard)
+{
+	pj_thread_desc thread_desc;
+	pj_thread_t* thread;
+	pj_thread_register("rtp_shard", thread_desc, &thread);
+
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(shard->cpu, &cpus);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+		PJ_LOG(2,(THIS_FILE, "Cannot pin RTP shard on port %u to CPU %u", shard->port, shard->cpu));
+
+	//everything the thread reads into lives here - nothing is allocated once it is going
+	std::vector<uint8_t> buffers(shard->batch * MAX_DATAGRAM);
+	std::vector<struct mmsghdr> msgs(shard->batch);
+	std::vector<struct iovec> iovs(shard->batch);
+	std::vector<pj_sockaddr> sources(shard->batch);
+
+	while (running.load(std::memory_order_relaxed))
+	{
+		for (unsigned i=0; i<shard->batch; i++)
+		{
+			iovs[i].iov_base = &buffers[i * MAX_DATAGRAM];
+			iovs[i].iov_len = MAX_DATAGRAM;
+			memset(&msgs[i], 0, sizeof(msgs[i]));
+			msgs[i].msg_hdr.msg_name = &sources[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		//block for the first datagram, then take whatever else is already waiting
+		int n = recvmmsg(shard->fd, msgs.data(), shard->batch, MSG_WAITFORONE, NULL);
+		if (n <= 0)
+			continue;
+
+		std::lock_guard<std::mutex> lock(shard->mutex);
+
+		for (int i=0; i<n; i++)
+		{
+			const pj_sockaddr& src = sources[i];
+			auto it = shard->streams.find(key_of(src.ipv4.sin_addr.s_addr, src.ipv4.sin_port));
+
+			if (it == shard->streams.end())
+				shard->strays.fetch_add(1, std::memory_order_relaxed);
+			else
+				deliver(it->second, iovs[i].iov_base, msgs[i].msg_len, &src);
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <atomic>
+#include <cstdint>
+
+//receives RTP for many streams on a few sockets rather than one socket per stream in pjmedia's ioqueue. Each shard
+//is a socket on a port of its own, read with recvmmsg by a thread pinned to a core of its own. A stream is given a
+//shard when its transport is created, advertises the shard's port in its SDP, and is found again from the source
+//address of what arrives - so the far end has to send from where its SDP said, which pjmedia does
+class RtpShards {
+public:
+	//hands a received packet to the stream it belongs to - on the shard thread
+	typedef void (*DeliverFn)(void* owner, void* pkt, pj_ssize_t size, const pj_sockaddr* src);
+
+	//bind shards sockets on base_port upwards and start their threads, pinned from first_cpu upwards. batch is the
+	//most datagrams taken by one recvmmsg. Exits if a port cannot be bound
+	static void Start(unsigned shards, uint16_t base_port, unsigned first_cpu, unsigned batch, DeliverFn deliver);
+	static void Stop();
+
+	static bool Running() { return running.load(std::memory_order_relaxed); }
+
+	//the shard for a new stream - round robin
+	static int Assign();
+
+	//host order
+	static uint16_t Port(int shard);
+
+	//RTP to a stream's far end goes out of its shard's socket, so it comes from the port the far end sends to
+	static pj_sock_t Socket(int shard);
+
+	//start and stop delivering what arrives on the shard from remote (IPv4 only) to owner. Unbind waits for any
+	//delivery to owner in progress, so owner can go once it returns
+	static bool Bind(int shard, const pj_sockaddr& remote, void* owner);
+	static void Unbind(int shard, const pj_sockaddr& remote, void* owner);
+
+	//datagrams that arrived from an address no stream was bound to
+	static uint64_t Strays();
+
+private:
+	struct Shard;
+
+	static void Run(Shard* shard);
+
+	static Shard* shards;
+	static unsigned count;
+	static DeliverFn deliver;
+	static std::atomic<bool> running;
+	static std::atomic<unsigned> next;
+};
@@ -0,0 +1,176 @@
+#include "RtpStats.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+RtpCounters* RtpStats::slots = NULL;
+RtpSnapshot* RtpStats::baselines = NULL;
+unsigned RtpStats::capacity = 0;
+
+static uint64_t now_ns()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void RtpCounters::CountRx(pj_ssize_t size)
+{
+	uint64_t now = now_ns();
+	uint64_t last = last_rx_ns.exchange(now, std::memory_order_relaxed);
+
+	rx_packets.fetch_add(1, std::memory_order_relaxed);
+	if (size > 0)
+		rx_bytes.fetch_add(size, std::memory_order_relaxed);
+
+	if (last && now > last)
+	{
+		uint64_t gap_us = (now - last) / 1000;
+		unsigned bucket = gap_us ? 64 - __builtin_clzll(gap_us) : 0;
+		if (bucket >= IA_BUCKETS)
+			bucket = IA_BUCKETS - 1;
+		interarrival[bucket].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void RtpCounters::CountRxRtcp(pj_ssize_t size)
+{
+	rx_rtcp_packets.fetch_add(1, std::memory_order_relaxed);
+	if (size > 0)
+		rx_rtcp_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void RtpCounters::CountTx(pj_size_t size, pj_status_t status)
+{
+	if (status != PJ_SUCCESS)
+	{
+		tx_errors.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	tx_packets.fetch_add(1, std::memory_order_relaxed);
+	tx_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+void RtpCounters::CountTxRtcp(pj_size_t size, pj_status_t status)
+{
+	if (status != PJ_SUCCESS)
+	{
+		tx_errors.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	tx_rtcp_packets.fetch_add(1, std::memory_order_relaxed);
+	tx_rtcp_bytes.fetch_add(size, std::memory_order_relaxed);
+}
+
+uint64_t RtpSnapshot::InterarrivalPercentile(double fraction) const
+{
+	uint64_t count = 0;
+
+	for (unsigned i=0; i<RtpCounters::IA_BUCKETS; i++)
+		count += interarrival[i];
+	if (count == 0)
+		return 0;
+
+	uint64_t want = (uint64_t)(fraction * count);
+	uint64_t seen = 0;
+	for (unsigned i=0; i<RtpCounters::IA_BUCKETS; i++)
+	{
+		seen += interarrival[i];
+		if (seen > want)
+			return (uint64_t)1 << i;
+	}
+	return (uint64_t)1 << (RtpCounters::IA_BUCKETS - 1);
+}
+
+void RtpStats::Init(unsigned max_calls)
+{
+	void* mem;
+
+	if (slots)
+		return;
+
+	if (posix_memalign(&mem, alignof(RtpCounters), sizeof(RtpCounters) * (max_calls + 1)) != 0)
+	{
+		std::cerr << "WTF - cannot allocate RTP counters for " << max_calls << " calls";
+		exit(-1);
+	}
+
+	//all zero is a valid state for the atomics - value initialising each slot gets us that
+	slots = (RtpCounters*)mem;
+	for (unsigned i=0; i<=max_calls; i++)
+		new (&slots[i]) RtpCounters();
+
+	baselines = new RtpSnapshot[max_calls + 1]();
+	capacity = max_calls;
+}
+
+RtpCounters* RtpStats::Bind(pjsua_call_id call_id)
+{
+	unsigned index = (call_id < 0 || (unsigned)call_id >= capacity) ? capacity : call_id;
+
+	//a new call starts with no previous packet to measure the gap from
+	slots[index].last_rx_ns.store(0, std::memory_order_relaxed);
+	Read(slots[index], baselines[index]);
+	return &slots[index];
+}
+
+void RtpStats::Read(const RtpCounters& counters, RtpSnapshot& snap)
+{
+	snap.rx_packets = counters.rx_packets.load(std::memory_order_relaxed);
+	snap.rx_bytes = counters.rx_bytes.load(std::memory_order_relaxed);
+	snap.rx_rtcp_packets = counters.rx_rtcp_packets.load(std::memory_order_relaxed);
+	snap.rx_rtcp_bytes = counters.rx_rtcp_bytes.load(std::memory_order_relaxed);
+	snap.tx_packets = counters.tx_packets.load(std::memory_order_relaxed);
+	snap.tx_bytes = counters.tx_bytes.load(std::memory_order_relaxed);
+	snap.tx_rtcp_packets = counters.tx_rtcp_packets.load(std::memory_order_relaxed);
+	snap.tx_rtcp_bytes = counters.tx_rtcp_bytes.load(std::memory_order_relaxed);
+	snap.tx_errors = counters.tx_errors.load(std::memory_order_relaxed);
+	for (unsigned i=0; i<RtpCounters::IA_BUCKETS; i++)
+		snap.interarrival[i] = counters.interarrival[i].load(std::memory_order_relaxed);
+}
+
+bool RtpStats::TakeCall(pjsua_call_id call_id, RtpSnapshot& snap)
+{
+	if (call_id < 0 || (unsigned)call_id >= capacity)
+		return false;
+
+	const RtpSnapshot& base = baselines[call_id];
+	Read(slots[call_id], snap);
+
+	snap.rx_packets -= base.rx_packets;
+	snap.rx_bytes -= base.rx_bytes;
+	snap.rx_rtcp_packets -= base.rx_rtcp_packets;
+	snap.rx_rtcp_bytes -= base.rx_rtcp_bytes;
+	snap.tx_packets -= base.tx_packets;
+	snap.tx_bytes -= base.tx_bytes;
+	snap.tx_rtcp_packets -= base.tx_rtcp_packets;
+	snap.tx_rtcp_bytes -= base.tx_rtcp_bytes;
+	snap.tx_errors -= base.tx_errors;
+	for (unsigned i=0; i<RtpCounters::IA_BUCKETS; i++)
+		snap.interarrival[i] -= base.interarrival[i];
+	return true;
+}
+
+void RtpStats::TakeTotal(RtpSnapshot& snap)
+{
+	memset(&snap, 0, sizeof(snap));
+
+	for (unsigned s=0; s<=capacity && slots; s++)
+	{
+		RtpSnapshot one;
+		Read(slots[s], one);
+
+		snap.rx_packets += one.rx_packets;
+		snap.rx_bytes += one.rx_bytes;
+		snap.rx_rtcp_packets += one.rx_rtcp_packets;
+		snap.rx_rtcp_bytes += one.rx_rtcp_bytes;
+		snap.tx_packets += one.tx_packets;
+		snap.tx_bytes += one.tx_bytes;
+		snap.tx_rtcp_packets += one.tx_rtcp_packets;
+		snap.tx_rtcp_bytes += one.tx_rtcp_bytes;
+		snap.tx_errors += one.tx_errors;
+		for (unsigned i=0; i<RtpCounters::IA_BUCKETS; i++)
+			snap.interarrival[i] += one.interarrival[i];
+	}
+}
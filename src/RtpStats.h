@@ -0,0 +1,77 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <atomic>
+#include <cstdint>
+
+//what the tp_adapter sees go through it. Every counter only ever goes up and is bumped with a relaxed atomic
+//increment on the media thread handling the packet - nothing on the packet path takes a lock
+struct alignas(64) RtpCounters
+{
+	//inter arrival times of received RTP in log2 buckets - bucket n counts gaps of [2^(n-1), 2^n) microseconds
+	static const unsigned IA_BUCKETS = 32;
+
+	std::atomic<uint64_t> rx_packets;
+	std::atomic<uint64_t> rx_bytes;
+	std::atomic<uint64_t> rx_rtcp_packets;
+	std::atomic<uint64_t> rx_rtcp_bytes;
+	std::atomic<uint64_t> tx_packets;
+	std::atomic<uint64_t> tx_bytes;
+	std::atomic<uint64_t> tx_rtcp_packets;
+	std::atomic<uint64_t> tx_rtcp_bytes;
+	std::atomic<uint64_t> tx_errors;
+	std::atomic<uint64_t> interarrival[IA_BUCKETS];
+	std::atomic<uint64_t> last_rx_ns; //steady clock time of the last RTP received - 0 until the first one arrives
+
+	void CountRx(pj_ssize_t size);
+	void CountRxRtcp(pj_ssize_t size);
+	void CountTx(pj_size_t size, pj_status_t status);
+	void CountTxRtcp(pj_size_t size, pj_status_t status);
+};
+
+//plain copy of a set of counters - or the sum of them
+struct RtpSnapshot
+{
+	uint64_t rx_packets;
+	uint64_t rx_bytes;
+	uint64_t rx_rtcp_packets;
+	uint64_t rx_rtcp_bytes;
+	uint64_t tx_packets;
+	uint64_t tx_bytes;
+	uint64_t tx_rtcp_packets;
+	uint64_t tx_rtcp_bytes;
+	uint64_t tx_errors;
+	uint64_t interarrival[RtpCounters::IA_BUCKETS];
+
+	//upper bound in microseconds of the bucket holding the given fraction of the inter arrival times - 0 if none
+	uint64_t InterarrivalPercentile(double fraction) const;
+};
+
+//one set of counters per possible call id, built at startup. An adapter binds to the slot of its call when it is
+//created and takes a baseline, so the per call figures start from 0 while the totals never go backwards - even
+//once the adapter is gone
+class RtpStats {
+public:
+	//call after pjsua_init() - max_calls as configured there
+	static void Init(unsigned max_calls);
+
+	//the overflow slot - for an adapter that does not know its call yet
+	static RtpCounters* Unbound() { return &slots[capacity]; }
+
+	//counters for the adapter being created for call_id - calls out of range all share an overflow slot
+	static RtpCounters* Bind(pjsua_call_id call_id);
+
+	//what has gone through the adapter of this call since it was bound - false if call_id is out of range
+	static bool TakeCall(pjsua_call_id call_id, RtpSnapshot& snap);
+
+	//everything, from every adapter there has been
+	static void TakeTotal(RtpSnapshot& snap);
+
+private:
+	static void Read(const RtpCounters& counters, RtpSnapshot& snap);
+
+	static RtpCounters* slots;    //capacity + 1 - the last is the overflow slot
+	static RtpSnapshot* baselines;
+	static unsigned capacity;
+};
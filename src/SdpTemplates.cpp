@@ -0,0 +1,85 @@
+#include "SdpTemplates.h"
+
+pj_pool_t* SdpTemplates::pool = NULL;
+pjmedia_sdp_attr* SdpTemplates::simulator[eSimulatorDirectionType::_size_constant];
+pjmedia_sdp_attr* SdpTemplates::agent[eAgentDirectionType::_size_constant];
+
+void SdpTemplates::Init(bool signalling_only)
+{
+	if (pool)
+		return;
+
+	pool = pjsua_pool_create("sdp_templates", 512, 512);
+
+	if (signalling_only)
+	{
+		pjmedia_sdp_attr* inactive = pjmedia_sdp_attr_create(pool, "inactive", NULL);
+
+		for (auto dir : eSimulatorDirectionType::_values())
+			simulator[dir._to_integral()] = inactive;
+		for (auto dir : eAgentDirectionType::_values())
+			agent[dir._to_integral()] = inactive;
+		return;
+	}
+
+	//we offer uni directional calls as send only, and answer them as receive only. Bi directional is what pjsua
+	//puts in anyway, so those are left as they are (NULL)
+	for (auto dir : eSimulatorDirectionType::_values())
+	{
+		switch (dir)
+		{
+		case eSimulatorDirectionType::SIMULATED_UNI_DIRECTIONAL:
+			simulator[dir._to_integral()] = pjmedia_sdp_attr_create(pool, "sendonly", NULL);
+			break;
+		case eSimulatorDirectionType::SIMULATE_BI_DIRECTIONAL:
+			simulator[dir._to_integral()] = NULL;
+			break;
+		}
+	}
+
+	for (auto dir : eAgentDirectionType::_values())
+	{
+		switch (dir)
+		{
+		case eAgentDirectionType::ANSWER_UNI_DIRECTIONAL:
+			agent[dir._to_integral()] = pjmedia_sdp_attr_create(pool, "recvonly", NULL);
+			break;
+		case eAgentDirectionType::ANSWER_BI_DIRECTIONAL:
+			agent[dir._to_integral()] = NULL;
+			break;
+		}
+	}
+}
+
+void SdpTemplates::ApplyDirection(pjmedia_sdp_session* sdp, eSimulatorDirectionType dir)
+{
+	Patch(sdp, simulator[dir._to_integral()]);
+}
+
+void SdpTemplates::ApplyDirection(pjmedia_sdp_session* sdp, eAgentDirectionType dir)
+{
+	Patch(sdp, agent[dir._to_integral()]);
+}
+
+void SdpTemplates::Patch(pjmedia_sdp_session* sdp, pjmedia_sdp_attr* direction)
+{
+	static const pj_str_t sendrecv = { (char*)"sendrecv", 8 };
+
+	if (!direction)
+		return;
+
+	//only a=sendrecv is ours to narrow - anything else is pjsua answering a one way offer and has to stay
+	for (unsigned m=0; m<sdp->media_count; m++)
+	{
+		pjmedia_sdp_media* media = sdp->media[m];
+
+		for (unsigned a=0; a<media->attr_count; a++)
+		{
+			if (pj_strcmp(&media->attr[a]->name, &sendrecv) == 0)
+			{
+				media->attr[a] = direction;
+				break;
+			}
+		}
+	}
+}
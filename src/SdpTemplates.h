@@ -0,0 +1,28 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include "CallContext.h"
+
+//the direction attribute each of our direction modes wants on every media line, built once at startup. pjsua
+//builds the rest of the SDP - ports and addresses come from the media transport of the call - so the only per call
+//work left is pointing the direction attribute of each media line at the shared one.
+//
+//Sharing the attribute is safe as pjsip never changes the SDP it is handed - the negotiator clones it first
+class SdpTemplates {
+public:
+	//call after pjsua_create(). Signalling only runs offer and answer every call inactive, whatever its mode, so no
+	//stream is ever started for it
+	static void Init(bool signalling_only);
+
+	//point the a=sendrecv of every media line at the attribute for the mode - no allocation, nothing moved
+	static void ApplyDirection(pjmedia_sdp_session* sdp, eSimulatorDirectionType dir);
+	static void ApplyDirection(pjmedia_sdp_session* sdp, eAgentDirectionType dir);
+
+private:
+	static void Patch(pjmedia_sdp_session* sdp, pjmedia_sdp_attr* direction);
+
+	static pj_pool_t* pool;
+	static pjmedia_sdp_attr* simulator[eSimulatorDirectionType::_size_constant];
+	static pjmedia_sdp_attr* agent[eAgentDirectionType::_size_constant];
+};
@@ -0,0 +1,321 @@
+#include "ShardSupervisor.h"
+
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+
+ShardSupervisor::ShardSupervisor(unsigned _workers):workers(_workers),slots(NULL),mappedSize(0),pids(NULL),
+		stopPublishing(false)
+{
+	mappedSize = sizeof(Slot) * workers;
+
+	//anonymous and shared - the children inherit it across fork and nobody else can see it
+	void* mem = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mem == MAP_FAILED)
+	{
+		std::cerr << "WTF - cannot map shared counters for " << workers << " workers: " << strerror(errno) << std::endl;
+		exit(-1);
+	}
+
+	slots = (Slot*)mem;
+	for (unsigned i=0; i<workers; i++)
+		new (&slots[i]) Slot();
+
+	pids = new pid_t[workers]();
+}
+
+ShardSupervisor::~ShardSupervisor()
+{
+	StopPublishing();
+	munmap(slots, mappedSize);
+	delete[] pids;
+}
+
+int ShardSupervisor::Fork(unsigned first_cpu)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus < 1)
+		cpus = 1;
+
+	for (unsigned i=0; i<workers; i++)
+	{
+		pid_t pid = fork();
+		if (pid < 0)
+		{
+			perror("fork failed with");
+			Signal(SIGTERM);
+			Reap(true);
+			exit(-1);
+		}
+
+		if (pid == 0)
+		{
+			//go when the supervisor does, however it goes
+			prctl(PR_SET_PDEATHSIG, SIGTERM);
+			BlockWorkerSignals();
+
+			cpu_set_t set;
+			CPU_ZERO(&set);
+			CPU_SET((first_cpu + i) % cpus, &set);
+			if (sched_setaffinity(0, sizeof(set), &set) != 0)
+				perror("sched_setaffinity failed with");
+
+			return i;
+		}
+
+		pids[i] = pid;
+		slots[i].summary.pid = pid;
+	}
+
+	printf("Started %u workers\n", workers);
+	return -1;
+}
+
+void ShardSupervisor::BlockWorkerSignals()
+{
+	sigset_t set;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGUSR1);
+	sigaddset(&set, SIGUSR2);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+bool ShardSupervisor::WaitForSupervisor(bool& hangup, bool& stop_generating)
+{
+	sigset_t set;
+	int sig;
+
+	sigemptyset(&set);
+	sigaddset(&set, SIGTERM);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGUSR1);
+	sigaddset(&set, SIGUSR2);
+
+	hangup = false;
+	stop_generating = false;
+
+	if (sigwait(&set, &sig) != 0)
+		return false;
+
+	hangup = sig == SIGUSR1;
+	stop_generating = sig == SIGUSR2;
+	return sig == SIGUSR1 || sig == SIGUSR2;
+}
+
+void ShardSupervisor::StartPublishing(unsigned worker, ActiveCallsFn active_calls, const CallGenerator* generator,
+		std::chrono::milliseconds interval)
+{
+	stopPublishing = false;
+	publisher = std::thread([this, worker, active_calls, generator, interval]() mutable
+			{
+		while (!stopPublishing)
+		{
+			Publish(worker, active_calls, generator);
+			std::this_thread::sleep_for(interval);
+		}
+		Publish(worker, active_calls, generator);
+			});
+}
+
+void ShardSupervisor::StopPublishing()
+{
+	stopPublishing = true;
+	if (publisher.joinable())
+		publisher.join();
+}
+
+void ShardSupervisor::Publish(unsigned worker, ActiveCallsFn& active_calls, const CallGenerator* generator)
+{
+	static std::unique_ptr<DisconnectStats::Snapshot> cleared(new DisconnectStats::Snapshot);
+	static std::unique_ptr<WorkerSummary> summary(new WorkerSummary);
+
+	//build the summary privately, so the seqlock only has to cover the copy into shared memory
+	DisconnectStats::Take(*cleared);
+
+	summary->pid = getpid();
+	summary->updated_us = CallLatency::Now();
+	summary->active_calls = active_calls();
+	summary->attempts = generator ? generator->Attempts() : 0;
+	summary->failed = generator ? generator->Failed() : 0;
+	summary->suppressed = generator ? generator->Suppressed() : 0;
+	summary->cleared_total = cleared->total;
+	for (unsigned code=0; code<DisconnectStats::CODES; code++)
+		summary->cleared_by_code[code] = cleared->ByCode(code);
+	RtpStats::TakeTotal(summary->rtp);
+	for (auto milestone : eLatencyMilestone::_values())
+		CallLatency::Take(milestone, summary->latency[milestone._to_integral()]);
+
+	Slot& slot = slots[worker];
+	slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(&slot.summary, summary.get(), sizeof(WorkerSummary));
+	slot.seq.store(slot.seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+bool ShardSupervisor::Read(unsigned worker, WorkerSummary& summary) const
+{
+	const Slot& slot = slots[worker];
+
+	//a worker that died part way through a publish leaves the sequence odd for good - so do not wait forever
+	for (unsigned tries=0; tries<1000; tries++)
+	{
+		uint32_t before = slot.seq.load(std::memory_order_acquire);
+		if (before & 1)
+		{
+			sched_yield();
+			continue;
+		}
+
+		memcpy(&summary, &slot.summary, sizeof(WorkerSummary));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.seq.load(std::memory_order_relaxed) == before)
+			return summary.updated_us != 0;
+	}
+
+	return false;
+}
+
+void ShardSupervisor::Signal(int sig)
+{
+	for (unsigned i=0; i<workers; i++)
+	{
+		if (pids[i])
+			kill(pids[i], sig);
+	}
+}
+
+void ShardSupervisor::Reap(bool wait)
+{
+	for (unsigned i=0; i<workers; i++)
+	{
+		int status;
+
+		if (!pids[i] || waitpid(pids[i], &status, wait ? 0 : WNOHANG) != pids[i])
+			continue;
+
+		if (WIFSIGNALED(status))
+			printf("Worker %u (pid %d) killed by signal %d\n", i, pids[i], WTERMSIG(status));
+		else if (WEXITSTATUS(status) != 0 || !wait)
+			printf("Worker %u (pid %d) exited with %d\n", i, pids[i], WEXITSTATUS(status));
+		pids[i] = 0;
+	}
+}
+
+void ShardSupervisor::PrintSummary()
+{
+	std::unique_ptr<WorkerSummary> one(new WorkerSummary);
+	std::unique_ptr<WorkerSummary> total(new WorkerSummary);
+
+	memset(total.get(), 0, sizeof(WorkerSummary));
+	for (auto milestone : eLatencyMilestone::_values())
+		total->latency[milestone._to_integral()].Clear();
+
+	uint64_t now_us = CallLatency::Now();
+	for (unsigned i=0; i<workers; i++)
+	{
+		if (!Read(i, *one))
+		{
+			printf("Worker %u: nothing published yet\n", i);
+			continue;
+		}
+
+		printf("Worker %u (pid %d%s): active %u attempts %lu failed %lu cleared %lu rtp rx %lu tx %lu - %lums old\n",
+				i, one->pid, pids[i] ? "" : ", gone", one->active_calls, one->attempts, one->failed,
+				one->cleared_total, one->rtp.rx_packets, one->rtp.tx_packets, (now_us - one->updated_us) / 1000);
+
+		total->active_calls += one->active_calls;
+		total->attempts += one->attempts;
+		total->failed += one->failed;
+		total->suppressed += one->suppressed;
+		total->cleared_total += one->cleared_total;
+		for (unsigned code=0; code<DisconnectStats::CODES; code++)
+			total->cleared_by_code[code] += one->cleared_by_code[code];
+
+		total->rtp.rx_packets += one->rtp.rx_packets;
+		total->rtp.rx_bytes += one->rtp.rx_bytes;
+		total->rtp.rx_rtcp_packets += one->rtp.rx_rtcp_packets;
+		total->rtp.tx_packets += one->rtp.tx_packets;
+		total->rtp.tx_bytes += one->rtp.tx_bytes;
+		total->rtp.tx_rtcp_packets += one->rtp.tx_rtcp_packets;
+		total->rtp.tx_errors += one->rtp.tx_errors;
+		for (unsigned b=0; b<RtpCounters::IA_BUCKETS; b++)
+			total->rtp.interarrival[b] += one->rtp.interarrival[b];
+
+		for (auto milestone : eLatencyMilestone::_values())
+			total->latency[milestone._to_integral()].Merge(one->latency[milestone._to_integral()]);
+	}
+
+	printf("All workers: active calls %u attempts %lu failed %lu suppressed %lu\n",
+			total->active_calls, total->attempts, total->failed, total->suppressed);
+	printf("RTP rx pkts %lu bytes %lu rtcp %lu, tx pkts %lu bytes %lu rtcp %lu, send errors %lu\n",
+			total->rtp.rx_packets, total->rtp.rx_bytes, total->rtp.rx_rtcp_packets,
+			total->rtp.tx_packets, total->rtp.tx_bytes, total->rtp.tx_rtcp_packets, total->rtp.tx_errors);
+	printf("RTP inter arrival (us) p50 <%lu p90 <%lu p99 <%lu p99.9 <%lu\n",
+			total->rtp.InterarrivalPercentile(0.5),
+			total->rtp.InterarrivalPercentile(0.9),
+			total->rtp.InterarrivalPercentile(0.99),
+			total->rtp.InterarrivalPercentile(0.999));
+
+	printf("Latency (us)         count      p50      p90      p99    p99.9      max\n");
+	for (auto milestone : eLatencyMilestone::_values())
+	{
+		const LatencyHistogram::Snapshot& latency = total->latency[milestone._to_integral()];
+		printf("%-12s %13lu %8lu %8lu %8lu %8lu %8lu\n", milestone._to_string(), latency.count,
+				latency.Percentile(0.5), latency.Percentile(0.9),
+				latency.Percentile(0.99), latency.Percentile(0.999), latency.max);
+	}
+
+	printf("Calls cleared with reason (%lu total):\n", total->cleared_total);
+	for (unsigned code=0; code<DisconnectStats::CODES; code++)
+	{
+		if (total->cleared_by_code[code] > 0)
+			printf("%u %lu\n", code, total->cleared_by_code[code]);
+	}
+}
+
+int ShardSupervisor::Supervise()
+{
+	for (;;)
+	{
+		char option[10];
+
+		puts("Press 'h' to hangup all calls, 'g' to stop generating calls, 's' for the totals of all workers, 'q' to quit");
+		if (fgets(option, sizeof(option), stdin) == NULL)
+		{
+			puts("EOF while reading stdin, will quit now..");
+			break;
+		}
+
+		Reap(false);
+
+		if (option[0] == 'q')
+			break;
+
+		if (option[0] == 'h')
+			Signal(SIGUSR1);
+
+		if (option[0] == 'g')
+			Signal(SIGUSR2);
+
+		if (option[0] == 's')
+			PrintSummary();
+	}
+
+	Signal(SIGTERM);
+	Reap(true);
+	return 0;
+}
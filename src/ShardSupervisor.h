@@ -0,0 +1,87 @@
+#pragma once
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "CallGenerator.h"
+#include "DisconnectStats.h"
+#include "Enum.h"
+#include "LatencyHistogram.h"
+#include "RtpStats.h"
+
+//how the workers share out the SIP port
+//REUSEPORT - every worker listens on --port with SO_REUSEPORT and the kernel spreads connections between them
+//PORTS     - worker n listens on --port + n
+ENUM(eShardMode, uint16_t, REUSEPORT, PORTS);
+
+//what a worker publishes about itself for the supervisor to add up - plain data, copied whole under a seqlock
+struct WorkerSummary
+{
+	pid_t    pid;
+	uint64_t updated_us;   //CallLatency::Now() of the last publish - 0 until the first
+	uint32_t active_calls;
+	uint64_t attempts;
+	uint64_t failed;
+	uint64_t suppressed;
+	uint64_t cleared_total;
+	uint64_t cleared_by_code[DisconnectStats::CODES];
+	RtpSnapshot rtp;
+	LatencyHistogram::Snapshot latency[eLatencyMilestone::_size_constant];
+};
+
+//forks the worker processes, each a complete pjsua instance of its own pinned to a CPU, and collects their
+//figures through a shared memory block. Nothing is shared between the workers but that block - so there are no
+//cross process locks, each worker only ever writes its own summary
+class ShardSupervisor {
+public:
+	typedef std::function<uint32_t()> ActiveCallsFn;
+
+	//maps the shared block - call before any threads are started, pjsua included
+	explicit ShardSupervisor(unsigned workers);
+	~ShardSupervisor();
+
+	//start the workers, worker n pinned to CPU first_cpu + n (wrapping round the CPUs we have). Returns the worker
+	//index in the child, and -1 in the supervisor once every worker is running
+	int Fork(unsigned first_cpu);
+
+	//the supervisor console - 's' adds up the workers, 'h' and 'g' are passed on to them, 'q' stops them all.
+	//Returns once every worker has gone
+	int Supervise();
+
+	//worker side - block the signals the supervisor drives us with, so the other threads never see them
+	static void BlockWorkerSignals();
+
+	//worker side - wait for the supervisor. Returns false when it is time to go; hangup and stop_generating are
+	//set when the supervisor passes on 'h' or 'g'
+	static bool WaitForSupervisor(bool& hangup, bool& stop_generating);
+
+	//worker side - publish our figures every interval until Stop
+	void StartPublishing(unsigned worker, ActiveCallsFn active_calls, const CallGenerator* generator,
+			std::chrono::milliseconds interval);
+	void StopPublishing();
+
+private:
+	struct alignas(64) Slot
+	{
+		std::atomic<uint32_t> seq; //odd while the summary is being written
+		WorkerSummary summary;
+	};
+
+	void Publish(unsigned worker, ActiveCallsFn& active_calls, const CallGenerator* generator);
+	bool Read(unsigned worker, WorkerSummary& summary) const;
+	void Signal(int sig);
+	void Reap(bool wait);
+	void PrintSummary();
+
+	const unsigned workers;
+	Slot* slots;        //workers of them, in a MAP_SHARED mapping
+	size_t mappedSize;
+	pid_t* pids;        //supervisor only - 0 once the worker has been reaped
+
+	std::thread publisher;
+	std::atomic<bool> stopPublishing;
+};
@@ -0,0 +1,113 @@
+#include "SipTransports.h"
+
+#include <sys/socket.h>
+
+#include <cstdlib>
+#include <iostream>
+
+#define THIS_FILE "SIP_TRANSPORTS"
+
+bool SipTransports::ParseListener(const std::string& spec, eSipTransport& type, unsigned& port)
+{
+	std::string::size_type colon = spec.find(':');
+	std::string name = spec.substr(0, colon);
+
+	auto parsed = eSipTransport::_from_string_nocase_nothrow(name.c_str());
+	if (!parsed)
+		return false;
+	type = *parsed;
+
+	if (colon == std::string::npos)
+	{
+		port = DefaultPort(type);
+		return true;
+	}
+
+	char* end;
+	unsigned long value = strtoul(spec.c_str() + colon + 1, &end, 10);
+	if (*end != 0 || end == spec.c_str() + colon + 1 || value == 0 || value > 65535)
+		return false;
+
+	port = value;
+	return true;
+}
+
+unsigned SipTransports::DefaultPort(eSipTransport type)
+{
+	return type == +eSipTransport::TLS ? 5061 : 5060;
+}
+
+pjsip_transport_type_e SipTransports::PjType(eSipTransport type)
+{
+	switch (type)
+	{
+	case eSipTransport::UDP:
+		return PJSIP_TRANSPORT_UDP;
+	case eSipTransport::TCP:
+		return PJSIP_TRANSPORT_TCP;
+	case eSipTransport::TLS:
+		return PJSIP_TRANSPORT_TLS;
+	}
+	return PJSIP_TRANSPORT_UNSPECIFIED;
+}
+
+const char* SipTransports::UriParam(eSipTransport type)
+{
+	switch (type)
+	{
+	case eSipTransport::UDP:
+		return "udp";
+	case eSipTransport::TCP:
+		return "tcp";
+	case eSipTransport::TLS:
+		return "tls";
+	}
+	return "";
+}
+
+pjsua_transport_id SipTransports::Listen(eSipTransport type, unsigned port, const TlsFiles& tls, bool reuseport)
+{
+	pjsua_transport_config cfg;
+	pjsua_transport_id id;
+
+	pjsua_transport_config_default(&cfg);
+	cfg.port = port;
+
+	static int reuse = 1;
+	if (reuseport)
+	{
+		cfg.sockopt_params.options[cfg.sockopt_params.cnt].level = pj_SOL_SOCKET();
+		cfg.sockopt_params.options[cfg.sockopt_params.cnt].optname = SO_REUSEPORT;
+		cfg.sockopt_params.options[cfg.sockopt_params.cnt].optval = &reuse;
+		cfg.sockopt_params.options[cfg.sockopt_params.cnt].optlen = sizeof(reuse);
+		cfg.sockopt_params.cnt++;
+	}
+
+	if (type == +eSipTransport::TLS)
+	{
+		if (tls.cert.empty() || tls.key.empty())
+		{
+			std::cerr << "WTF - a TLS listener needs --tls-cert and --tls-key" << std::endl;
+			exit(-1);
+		}
+
+		//pjsua copies the settings into the transport, so pointing at our strings is fine
+		cfg.tls_setting.cert_file = pj_str((char*)tls.cert.c_str());
+		cfg.tls_setting.privkey_file = pj_str((char*)tls.key.c_str());
+		if (!tls.ca.empty())
+			cfg.tls_setting.ca_list_file = pj_str((char*)tls.ca.c_str());
+		if (!tls.password.empty())
+			cfg.tls_setting.password = pj_str((char*)tls.password.c_str());
+	}
+
+	pj_status_t status = pjsua_transport_create(PjType(type), &cfg, &id);
+	if (status != PJ_SUCCESS)
+	{
+		PJ_PERROR(1,(THIS_FILE, status, "Error creating %s listener on port %u", type._to_string(), port));
+		std::cerr << "WTF - cannot listen on " << UriParam(type) << ":" << port << std::endl;
+		exit(-1);
+	}
+
+	PJ_LOG(3,(THIS_FILE, "Listening on %s:%u", UriParam(type), port));
+	return id;
+}
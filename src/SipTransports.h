@@ -0,0 +1,35 @@
+#pragma once
+
+#include <pjsua-lib/pjsua.h>
+
+#include <string>
+
+#include "Enum.h"
+
+ENUM(eSipTransport, uint16_t, UDP, TCP, TLS);
+
+//where TLS listeners get their certificate - a self signed one is fine for load testing:
+//  openssl req -x509 -newkey rsa:2048 -nodes -keyout key.pem -out cert.pem -days 365 -subj /CN=localhost
+struct TlsFiles
+{
+	std::string cert;
+	std::string key;
+	std::string ca;       //optional - only needed to verify the far end, which we do not by default
+	std::string password; //optional - for an encrypted key
+};
+
+//creating the SIP listeners pjsua sends and receives on
+class SipTransports {
+public:
+	//"udp:5060", "tcp:5070" or "tls:5061" - the port may be left off for the default of the transport
+	static bool ParseListener(const std::string& spec, eSipTransport& type, unsigned& port);
+
+	static unsigned DefaultPort(eSipTransport type);
+	static pjsip_transport_type_e PjType(eSipTransport type);
+
+	//what goes in ;transport= on a URI
+	static const char* UriParam(eSipTransport type);
+
+	//open a listener - reuseport lets several processes bind the same port. Exits if the listener cannot be made
+	static pjsua_transport_id Listen(eSipTransport type, unsigned port, const TlsFiles& tls, bool reuseport);
+};
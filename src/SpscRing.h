@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+//fixed size single producer, single consumer queue of T. Slots are filled and drained in place, so nothing is
+//copied twice and nothing allocates once the ring is built. Head and tail sit on cache lines of their own, so the
+//two threads only share a line when one of them looks at the other's end
+template <typename T, uint32_t SLOTS>
+class SpscRing {
+public:
+	static_assert((SLOTS & (SLOTS - 1)) == 0, "SLOTS must be a power of 2");
+
+	SpscRing():head(0),tail(0) {}
+
+	//producer - the next free slot to fill, or NULL if the ring is full. Nothing is queued until Commit
+	T* Claim()
+	{
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) >= SLOTS)
+			return NULL;
+		return &slots[h & (SLOTS - 1)];
+	}
+
+	void Commit()
+	{
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	//consumer - the i'th queued slot, oldest first, or NULL if fewer than i+1 are queued
+	T* Peek(uint32_t i = 0)
+	{
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (head.load(std::memory_order_acquire) - t <= i)
+			return NULL;
+		return &slots[(t + i) & (SLOTS - 1)];
+	}
+
+	//hand the n oldest slots back to the producer
+	void Pop(uint32_t n = 1)
+	{
+		tail.store(tail.load(std::memory_order_relaxed) + n, std::memory_order_release);
+	}
+
+private:
+	alignas(64) std::atomic<uint32_t> head; //only written by the producer
+	alignas(64) std::atomic<uint32_t> tail; //only written by the consumer
+	alignas(64) T slots[SLOTS];
+};
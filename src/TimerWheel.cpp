@@ -0,0 +1,130 @@
+#include "TimerWheel.h"
+
+TimerWheel::TimerWheel(std::chrono::milliseconds _tick):start(Clock::now()),tick(_tick),current(0),armed(0)
+{
+	for (unsigned level=0; level<LEVELS; level++)
+	{
+		for (unsigned i=0; i<SLOTS; i++)
+		{
+			slots[level][i].prev = &slots[level][i];
+			slots[level][i].next = &slots[level][i];
+		}
+	}
+}
+
+uint64_t TimerWheel::TickAt(Clock::time_point t) const
+{
+	return (t - start) / tick;
+}
+
+TimerWheel::Clock::time_point TimerWheel::NextTick() const
+{
+	return start + tick * (current + 1);
+}
+
+void TimerWheel::Unlink(TimerNode* node)
+{
+	node->prev->next = node->next;
+	node->next->prev = node->prev;
+	node->prev = NULL;
+	node->next = NULL;
+}
+
+//pick the level from how far away the expiry is, and the slot from the expiry itself - so when level n wraps back
+//to slot 0 the slot of level n+1 it cascades holds exactly the timers due in the next pass of level n
+void TimerWheel::Insert(TimerNode* node)
+{
+	uint64_t expires = node->expires;
+	if (expires < current)
+		expires = current; //already due - fire on the next tick processed
+
+	uint64_t delta = expires - current;
+	unsigned level = 0;
+
+	while (level < LEVELS - 1 && delta >= ((uint64_t)1 << (SLOT_BITS * (level + 1))))
+		level++;
+
+	//anything beyond the top level waits in the furthest slot and is re-cascaded until it is in range
+	if (delta >= ((uint64_t)1 << (SLOT_BITS * LEVELS)))
+		expires = current + ((uint64_t)1 << (SLOT_BITS * LEVELS)) - 1;
+
+	TimerNode* head = &slots[level][(expires >> (SLOT_BITS * level)) & (SLOTS - 1)];
+	node->next = head;
+	node->prev = head->prev;
+	head->prev->next = node;
+	head->prev = node;
+}
+
+void TimerWheel::Cascade(unsigned level, unsigned index)
+{
+	TimerNode* head = &slots[level][index];
+
+	while (head->next != head)
+	{
+		TimerNode* node = head->next;
+		Unlink(node);
+		Insert(node);
+	}
+}
+
+void TimerWheel::Arm(TimerNode* node, uint32_t delay_ms)
+{
+	uint64_t ticks = (std::chrono::milliseconds(delay_ms) + tick - Clock::duration(1)) / tick;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (node->Armed())
+		Unlink(node);
+	else
+		armed++;
+
+	//count from real time rather than from the wheel, which can lag a tick or two behind
+	node->expires = TickAt(Clock::now()) + (ticks ? ticks : 1);
+	Insert(node);
+}
+
+bool TimerWheel::Cancel(TimerNode* node)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	if (!node->Armed())
+		return false;
+
+	Unlink(node);
+	armed--;
+	return true;
+}
+
+size_t TimerWheel::Advance(Clock::time_point now, ExpiryFn fn, void* ctx)
+{
+	const uint64_t target = TickAt(now);
+	size_t expired = 0;
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	while (current <= target)
+	{
+		//level 0 has wrapped - pull the next slot of each level that has wrapped down into the one below
+		for (unsigned level=1; level<LEVELS; level++)
+		{
+			unsigned index = (current >> (SLOT_BITS * level)) & (SLOTS - 1);
+			if ((current & (((uint64_t)1 << (SLOT_BITS * level)) - 1)) != 0)
+				break;
+			Cascade(level, index);
+		}
+
+		TimerNode* head = &slots[0][current & (SLOTS - 1)];
+		while (head->next != head)
+		{
+			TimerNode* node = head->next;
+			Unlink(node);
+			armed--;
+			expired++;
+			fn(node, ctx);
+		}
+
+		current++;
+	}
+
+	return expired;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+
+//intrusive timer - embed one in whatever needs timing and recover the owner in the expiry function. A node is
+//armed while it is linked into the wheel
+struct TimerNode
+{
+	TimerNode* prev;
+	TimerNode* next;
+	uint64_t   expires; //wheel tick the node fires on
+
+	TimerNode():prev(NULL),next(NULL),expires(0) {}
+
+	bool Armed() const { return next != NULL; }
+};
+
+//hierarchical timing wheel - 4 levels of 256 slots. Level 0 holds timers due in the next 256 ticks, and each level
+//above covers 256 times the span of the one below; a level's slot is cascaded down as the level below wraps.
+//Arm and Cancel are O(1) and the expired timers for a tick come off as a whole slot.
+//
+//Arm and Cancel may be called from any thread; Advance is meant to be driven by a single thread
+class TimerWheel {
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	//called under the wheel lock for each expired node, which has already been unlinked - copy out what is needed
+	//and do the real work after Advance returns
+	typedef void (*ExpiryFn)(TimerNode* node, void* ctx);
+
+	static const unsigned LEVELS = 4;
+	static const unsigned SLOT_BITS = 8;
+	static const unsigned SLOTS = 1 << SLOT_BITS;
+
+	explicit TimerWheel(std::chrono::milliseconds tick);
+
+	//(re)arm node to fire delay_ms from now - rounded up to the next tick
+	void Arm(TimerNode* node, uint32_t delay_ms);
+
+	//returns false if the node was not armed, i.e. it has already fired or was never armed
+	bool Cancel(TimerNode* node);
+
+	//run every tick up to now, calling fn for each expired node. Returns the number of nodes expired
+	size_t Advance(Clock::time_point now, ExpiryFn fn, void* ctx);
+
+	//when the next tick is due - the driving thread sleeps until then
+	Clock::time_point NextTick() const;
+
+	uint64_t ArmedCount() const { return armed; }
+
+private:
+	uint64_t TickAt(Clock::time_point t) const;
+	void Insert(TimerNode* node);
+	void Cascade(unsigned level, unsigned index);
+
+	static void Unlink(TimerNode* node);
+
+	const Clock::time_point start;
+	const Clock::duration tick;
+
+	std::mutex mutex;
+	uint64_t current; //next tick to be processed
+	uint64_t armed;
+
+	TimerNode slots[LEVELS][SLOTS]; //list heads
+};